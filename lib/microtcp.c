@@ -18,18 +18,40 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#define _GNU_SOURCE
 #include "microtcp.h"
+#include "microtcp_cc.h"
 #include "../utils/crc32.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <poll.h>
 #include <sys/time.h>
+#include <sys/uio.h>
 #include <netinet/in.h>
+#include <netinet/ip.h>
+
+/* Largest datagram we ever expect from the peer */
+#define MICROTCP_MAX_SEGMENT (sizeof(microtcp_header_t) \
+                              + MICROTCP_MAX_SACK_BLOCKS * 2 * sizeof(uint32_t) + MICROTCP_MAX_MSS)
+
+/* A received segment, split in its parts */
+typedef struct
+{
+  microtcp_header_t header;     /**< The header in host byte order */
+  microtcp_range_t sack[MICROTCP_MAX_SACK_BLOCKS];
+  size_t sack_count;
+  const uint8_t *data;          /**< The payload, header.data_len bytes */
+} rx_segment_t;
 
 microtcp_sock_t
 microtcp_socket (int domain, int type, int protocol)
 {
   microtcp_sock_t s;
+  int on = 1;
   if ((s.sd = socket(domain, SOCK_DGRAM, IPPROTO_UDP)) == -1){
     perror("opening socket");
     s.state = INVALID;
@@ -42,10 +64,109 @@ microtcp_socket (int domain, int type, int protocol)
   s.bytes_send = 0;
   s.bytes_received = 0;
   s.bytes_lost = 0;
-  
-  struct timeval timeout;
-  timeout.tv_sec = 0;
-  timeout.tv_usec = MICROTCP_ACK_TIMEOUT_US;
+
+  s.mss = MICROTCP_MSS;
+  s.init_cwnd = MICROTCP_INIT_CWND_SEGS;
+  s.rto_init_us = MICROTCP_ACK_TIMEOUT_US;
+  s.rto_min_us = MICROTCP_MIN_RTO_US;
+  s.rto_max_us = MICROTCP_MAX_RTO_US;
+  s.recvbuf = NULL;
+  s.recvbuf_len = MICROTCP_RECVBUF_LEN;
+  s.rcvbuf_auto = 1;
+  s.recvbuf_head = 0;
+  s.recvbuf_tail = 0;
+  s.ooo_count = 0;
+  s.ooo_last = 0;
+  s.sack_permitted = 0;
+  s.ts_enabled = 0;
+  s.ts_recent = 0;
+  /* The ECN codepoint of received datagrams, to echo CE marks. Only
+     IPv4 sockets report it, the others go without ECN */
+  s.ecn_permitted = domain == AF_INET
+                    && setsockopt(s.sd, IPPROTO_IP, IP_RECVTOS, &on, sizeof(on)) == 0;
+  s.snd_wscale = 0;
+  s.rcv_wscale = 0;
+  s.rx_ce = 0;
+  s.ce_echo = 0;
+  s.rcv_rtt_us = 0;
+  s.rcv_rtt_seq = 0;
+  s.rcv_rtt_stamp_us = 0;
+  s.rcvq_head = 0;
+  s.rcvq_stamp_us = 0;
+  s.rcv_last_us = 0;
+  s.dsack_pending = 0;
+  s.dsack_start = 0;
+  s.dsack_end = 0;
+  s.ack_freq = MICROTCP_ACK_FREQ;
+  s.ack_delay_us = MICROTCP_ACK_DELAY_US;
+  s.peer_ack_delay_us = 0;
+  s.ack_pending = 0;
+  s.delack_timer_us = 0;
+  s.last_ack_sent = 0;
+  s.pingpong = 0;
+  s.rcv_wnd_edge = 0;
+  s.init_win_size = MICROTCP_WIN_SIZE;
+  s.curr_win_size = MICROTCP_WIN_SIZE;
+  s.cc = NULL;
+  microtcp_cc_attach(&s, microtcp_cc_find(MICROTCP_DEFAULT_CC));
+  s.snd_una = 0;
+  s.bytes_in_flight = 0;
+  s.write_seq = 0;
+  s.rtx_head = NULL;
+  s.rtx_tail = NULL;
+  s.unsent_head = NULL;
+  s.sndbuf_len = MICROTCP_SNDBUF_LEN;
+  s.sndbuf_auto = 1;
+  s.nodelay = 0;
+  s.cork = 0;
+  s.cork_timer_us = 0;
+  s.nagle_timer_us = 0;
+  s.max_peer_win = 0;
+  s.persist_timer_us = 0;
+  s.persist_backoff = 0;
+  s.persist_probes = 0;
+  s.dup_acks = 0;
+  s.in_recovery = 0;
+  s.recover = 0;
+  s.recovery_start_us = 0;
+  s.recover_fs = 0;
+  s.prr_delivered = 0;
+  s.prr_out = 0;
+  s.prr_credited = 0;
+  s.delivered = 0;
+  s.delivered_us = 0;
+  s.first_sent_us = 0;
+  s.app_limited = 0;
+  s.srtt_us = 0;
+  s.rttvar_us = 0;
+  s.rto_us = s.rto_init_us;
+  s.rtx_timer_us = 0;
+  s.rtx_backoff = 0;
+  s.min_rtt_us = 0;
+  s.pacing_next_us = 0;
+  s.pacing_timer_us = 0;
+  s.undo_valid = 0;
+  s.undo_rto = 0;
+  s.undo_marker = 0;
+  s.undo_cwnd = 0;
+  s.undo_ssthresh = 0;
+  s.undo_retrans = 0;
+  s.undo_ts = 0;
+  s.undo_end_seq = 0;
+  s.rack_xmit_us = 0;
+  s.rack_end_seq = 0;
+  s.rack_rtt_us = 0;
+  s.rack_fack = 0;
+  s.rack_reordering_seen = 0;
+  s.rack_reo_wnd_mult = 1;
+  s.rack_reo_wnd_persist = 0;
+  s.rack_dsack_round = 0;
+  s.rack_timer_us = 0;
+  s.tlp_timer_us = 0;
+  s.tlp_end_seq = 0;
+  s.tlp_ts = 0;
+  s.tlp_active = 0;
+  s.tlp_retrans = 0;
 
   s.state = UNKNOWN;
   return s;
@@ -63,6 +184,19 @@ microtcp_bind (microtcp_sock_t *socket, const struct sockaddr *address,
   return rv;
 }
 
+static uint64_t now_us (void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* The clock of the timestamp option, in microseconds */
+static uint32_t ts_now (void)
+{
+  return (uint32_t)now_us();
+}
+
 static uint16_t set_bit (uint16_t data, uint16_t pos)
 {
   return (data|(1 << pos));
@@ -89,10 +223,10 @@ static microtcp_header_t make_header (uint32_t seq_number,uint32_t ack_number,
   header.future_use2 = 0;
   header.checksum = 0;
   uint16_t tmp_control = 0;
-  if(ACK) set_bit(tmp_control, ACK_F);
-  if(RST) set_bit(tmp_control, RST_F);
-  if(SYN) set_bit(tmp_control, SYN_F);
-  if(FIN) set_bit(tmp_control, FIN_F);
+  if(ACK) tmp_control = set_bit(tmp_control, ACK_F);
+  if(RST) tmp_control = set_bit(tmp_control, RST_F);
+  if(SYN) tmp_control = set_bit(tmp_control, SYN_F);
+  if(FIN) tmp_control = set_bit(tmp_control, FIN_F);
   header.control = htons(tmp_control);
   header.checksum = htonl(crc32((uint8_t *)(&header), sizeof(header)));
 
@@ -118,7 +252,7 @@ static microtcp_header_t get_hbo_header (microtcp_header_t *nbo_header)
 }
 
 //returns 1 if header control is valid according to the given values, 0 otherwise
-static int is_header_control_valid (microtcp_header_t *hbo_header, uint8_t ACK, uint8_t RST, uint8_t SYN, uint8_t FIN)
+static int is_header_control_valid (const microtcp_header_t *hbo_header, uint8_t ACK, uint8_t RST, uint8_t SYN, uint8_t FIN)
 {
   if(ACK && get_bit(hbo_header->control, ACK_F) == 0)
     return 0;
@@ -136,7 +270,8 @@ static int is_equal_addresses (const struct sockaddr a, const struct sockaddr b)
 {
   if (a.sa_family != b.sa_family)
     return 0;
-  if (strcmp(a.sa_data, b.sa_data) != 0)
+  /* sa_data holds the port and the address in binary form, it is not a string */
+  if (memcmp(a.sa_data, b.sa_data, sizeof(a.sa_data)) != 0)
     return 0;
   else return 1;
 }
@@ -148,314 +283,2554 @@ static int is_equal_addresses (const struct sockaddr a, const struct sockaddr b)
 
 static int is_checksum_valid(const uint8_t *recv_buf, const size_t msg_len){
 
-  microtcp_header_t *tmp_header;
+  microtcp_header_t tmp_header;
   uint32_t received_checksum, calculated_checksum;
-  int i = 0, size = 0;
 
-  tmp_header = malloc(msg_len);
-  
-  memcpy(tmp_header, recv_buf, size);
+  if(msg_len < sizeof(microtcp_header_t))
+    return 0;
+
+  memcpy(&tmp_header, recv_buf, sizeof(tmp_header));
 
   /* check sum in received header */
-  received_checksum = ntohl(tmp_header->checksum);
+  received_checksum = ntohl(tmp_header.checksum);
 
-  /* calculate checksum of header for comparison */
-  calculated_checksum = ntohl(crc32(recv_buf, msg_len));
+  /* the checksum was calculated by the sender with the checksum field zeroed */
+  tmp_header.checksum = 0;
+  calculated_checksum = update_crc32(0xffffffff, (const uint8_t *)&tmp_header, sizeof(tmp_header));
+  calculated_checksum = update_crc32(calculated_checksum, recv_buf + sizeof(tmp_header),
+                                     msg_len - sizeof(tmp_header)) ^ 0xffffffff;
 
   return (received_checksum == calculated_checksum);
 }
 
+/* Bytes taken by the receive rings of all the sockets of the process */
+static atomic_size_t recvbuf_mem;
 
-int
-microtcp_connect (microtcp_sock_t *socket, const struct sockaddr *address,
-                  socklen_t address_len)
+/* Rounds len up to a power of two */
+static size_t round_pow2 (size_t len)
 {
-  microtcp_header_t syn, synack, ack;
-  struct sockaddr src_addr;
-  socklen_t src_addr_length;
-  ssize_t bytes_sent, ret;
-  char tmp_buf[MICROTCP_RECVBUF_LEN];
+  size_t pow2 = 1;
 
-  srand(time(NULL));
-  socket->seq_number = rand();  // create random sequence number
+  while(pow2 < len)
+    pow2 <<= 1;
+  return pow2;
+}
 
-  /* create the header for the 1st step of the 3-way handshake (SYN segment) */
-  syn = make_header(socket->seq_number, 0, 0, 0, 0, 0, 1, 0);
-  //syn->checksum = crc32(&synack, sizeof(synack));                             //add checksum
-  bytes_sent = sendto(socket->sd, &syn, sizeof((syn)), MSG_CONFIRM, address, address_len); //send segment
-  
-  if(bytes_sent != sizeof(syn))
-  {
-    perror("none or not all bytes of syn were sent\n"); 
-    socket->state = INVALID;
-    return socket->sd;
-  } 
-  socket->seq_number += 1;
-  socket->packets_send += 1;
-  socket->bytes_send += bytes_sent;
+/* Allocates an empty receive ring. Returns 0 on success, -1 on failure */
+static int alloc_recvbuf (microtcp_sock_t *socket)
+{
+  socket->recvbuf = malloc(socket->recvbuf_len * sizeof(uint8_t));
+  socket->recvbuf_head = 0;
+  socket->recvbuf_tail = 0;
+  socket->ooo_count = 0;
+  socket->rcv_last_us = now_us();
+  if(!socket->recvbuf){
+    perror("allocating receive buffer");
+    return -1;
+  }
+  atomic_fetch_add(&recvbuf_mem, socket->recvbuf_len);
+  return 0;
+}
 
-  //wait to receive the SYNACK from the specific address
-  do{
-    ret = recvfrom(socket->sd, tmp_buf, MICROTCP_RECVBUF_LEN, MSG_WAITALL, &src_addr, &src_addr_length);
-  }while(!is_equal_addresses(*address, src_addr));
-  
-  synack = get_hbo_header((microtcp_header_t *)&tmp_buf);
+static void free_recvbuf (microtcp_sock_t *socket)
+{
+  if(socket->recvbuf)
+    atomic_fetch_sub(&recvbuf_mem, socket->recvbuf_len);
+  free(socket->recvbuf);
+  socket->recvbuf = NULL;
+}
 
-  // received segment
-  if(ret<=0){
-    socket->state = ;
-    return socket->sd;
-  }
+/* The largest the receive ring may become, which sizes the window scale */
+static size_t recvbuf_max (const microtcp_sock_t *socket)
+{
+  return socket->rcvbuf_auto && socket->recvbuf_len < MICROTCP_RCVBUF_AUTO_MAX
+         ? MICROTCP_RCVBUF_AUTO_MAX : socket->recvbuf_len;
+}
 
-  // check if checksum in received header is valid
-  if(!is_checksum_valid(socket->recvbuf, ret)){
-    socket->state = INVALID;
-    return socket->sd;
-  }
+/* Free space of the receive ring, the window advertised to the peer */
+static size_t recvbuf_free (const microtcp_sock_t *socket)
+{
+  return socket->recvbuf_len - (socket->recvbuf_tail - socket->recvbuf_head);
+}
 
-  // check that SYN and ACK bits are set to 1
-  // check if ACK_received = SYN_sent + 1
-  if( !is_header_control_valid(&synack, 1, 0, 1, 0)
-   || synack.ack_number != socket->seq_number)
-  {
-    socket->state = INVALID;
-    return socket->sd;
-  }
-  //received valid SYNACK
-  socket->address = *address;
-  socket->address_len = address_len;
-  socket->recvbuf = malloc(MICROTCP_RECVBUF_LEN * sizeof(uint8_t));
-  socket->state = ESTABLISHED;  
-  socket->ack_number = synack.seq_number + 1;
+/* The smallest shift that lets a window of len bytes fit the 16-bit
+   window field */
+static uint8_t wscale_for (size_t len)
+{
+  uint8_t shift = 0;
 
-  //make header of last ack
-  ack = make_header(socket->seq_number, socket->ack_number, MICROTCP_WIN_SIZE, 0, 1, 0, 0, 0);
-  //ack->checksum = crc32(&synack, sizeof(synack)); //add checksum
+  while(shift < MICROTCP_MAX_WSCALE && (len >> shift) > 0xffff)
+    shift++;
+  return shift;
+}
 
-  //send last ack
-  bytes_sent = sendto(socket->sd, &ack, sizeof(ack), MSG_CONFIRM, address, address_len);
-  if(bytes_sent != sizeof(ack)){
-    socket->state = INVALID;
-    perror("none or not all ack bytes were sent");
-    return socket->sd;
-  } 
-  socket->seq_number += 1; 
+/* Room of the last window advertised that the peer has not filled yet */
+static size_t window_promised (const microtcp_sock_t *socket)
+{
+  if(SEQ_LT(socket->rcv_wnd_edge, socket->ack_number))
+    return 0;
+  return (uint32_t)(socket->rcv_wnd_edge - socket->ack_number);
+}
 
-  return socket->sd;
+/* Silly window syndrome avoidance on the receiver (RFC 1122 section
+   4.2.3.3): the right edge of the window only moves once it can move by
+   an MSS or half the buffer */
+static int window_may_open (const microtcp_sock_t *socket)
+{
+  size_t step = socket->recvbuf_len / 2 < socket->mss ? socket->recvbuf_len / 2 : socket->mss;
+
+  return recvbuf_free(socket) >= window_promised(socket) + step;
 }
 
+/* The window field for a segment about to be sent, advertising the free
+   receive space. The space is rounded down to the scale, never promising
+   more than fits */
+static uint16_t advertised_window (microtcp_sock_t *socket)
+{
+  size_t win = recvbuf_free(socket);
 
-/* microtcp.h: microtcp_access returns 0 on success */
+  if(!window_may_open(socket) && window_promised(socket) < win)
+    win = window_promised(socket);
+  win >>= socket->rcv_wscale;
+  if(win > 0xffff)
+    win = 0xffff;
+  socket->rcv_wnd_edge = socket->ack_number + (win << socket->rcv_wscale);
+  return win;
+}
 
-int
-microtcp_accept (microtcp_sock_t *socket, struct sockaddr *address,
-                 socklen_t address_len)
+/* The window field of a SYN, which is never scaled */
+static uint16_t syn_window (const microtcp_sock_t *socket)
 {
-  socket->recvbuf = malloc(MICROTCP_RECVBUF_LEN * sizeof(uint8_t));
-  socket->buf_fill_level = 0;
-  socket->init_win_size = MICROTCP_WIN_SIZE;
-  socket->curr_win_size = MICROTCP_WIN_SIZE;
-  
-  microtcp_header_t syn, synack, ack;
-  struct sockaddr src_addr;
-  socklen_t src_addr_length;
-  ssize_t bytes_sent, ret; 
+  return socket->recvbuf_len > 0xffff ? 0xffff : socket->recvbuf_len;
+}
 
-  //receive SYN segment from any address
-  do
-  {
-    ret = recvfrom(socket->sd, socket->recvbuf, MICROTCP_RECVBUF_LEN, MSG_WAITALL, &src_addr, &src_addr_length);
-    if (ret > 0)
-      syn = get_hbo_header((microtcp_header_t *)socket->recvbuf);
-  } while (!is_header_control_valid(&syn, 0, 0, 1, 0));
-  
-  //received SYN segment
+/* Copies len bytes into the receive ring at the given stream offset.
+   The copy wraps around the end of the ring in at most two memcpy() calls */
+static void recvbuf_write (microtcp_sock_t *socket, size_t offset, const uint8_t *data, size_t len)
+{
+  size_t idx = offset & (socket->recvbuf_len - 1);
+  size_t first = socket->recvbuf_len - idx;
 
-  // checksum validation
-  if(!is_checksum_valid(socket->recvbuf, ret)){
-    perror("checksum is invalid");
-    socket->state = INVALID;
-    return socket->sd;
+  if(first > len)
+    first = len;
+  memcpy(socket->recvbuf + idx, data, first);
+  memcpy(socket->recvbuf, data + first, len - first);
+}
+
+/* Moves up to len bytes of in-order data from the receive ring to the
+   application buffer. Returns the number of bytes copied */
+static size_t recvbuf_read (microtcp_sock_t *socket, uint8_t *buffer, size_t len)
+{
+  size_t avail = socket->recvbuf_tail - socket->recvbuf_head;
+  size_t idx = socket->recvbuf_head & (socket->recvbuf_len - 1);
+  size_t first;
+
+  if(len > avail)
+    len = avail;
+  first = socket->recvbuf_len - idx;
+  if(first > len)
+    first = len;
+  memcpy(buffer, socket->recvbuf + idx, first);
+  memcpy(buffer + first, socket->recvbuf, len - first);
+  socket->recvbuf_head += len;
+  return len;
+}
+
+/* Moves the receive ring to one of len bytes, a power of two, keeping the
+   unread and out-of-order data at their stream offsets. Growing the ring
+   past the auto-tuning budget of the process fails. Returns 0 on success,
+   -1 on failure */
+static int recvbuf_resize (microtcp_sock_t *socket, size_t len)
+{
+  uint8_t *old = socket->recvbuf;
+  size_t old_len = socket->recvbuf_len;
+  size_t held = socket->recvbuf_tail - socket->recvbuf_head;
+  size_t offset, idx, n;
+  uint8_t *buf;
+
+  if(socket->ooo_count > 0)
+    held += (uint32_t)(socket->ooo_ranges[socket->ooo_count - 1].end - socket->ack_number);
+  if(len < held)
+    return -1;
+  if(len > old_len && atomic_load(&recvbuf_mem) + (len - old_len) > MICROTCP_RCVBUF_MEM_MAX)
+    return -1;
+  buf = malloc(len);
+  if(!buf)
+    return -1;
+
+  socket->recvbuf = buf;
+  socket->recvbuf_len = len;
+  for(offset = socket->recvbuf_head; offset != socket->recvbuf_head + held; offset += n){
+    idx = offset & (old_len - 1);
+    n = old_len - idx;
+    if(n > socket->recvbuf_head + held - offset)
+      n = socket->recvbuf_head + held - offset;
+    recvbuf_write(socket, offset, old + idx, n);
   }
+  free(old);
+  if(len > old_len)
+    atomic_fetch_add(&recvbuf_mem, len - old_len);
+  else
+    atomic_fetch_sub(&recvbuf_mem, old_len - len);
+  return 0;
+}
 
-  //received valid SYN segment
-  srand(time(NULL));
-  socket->seq_number = rand(); //create random sequence number
-  socket->ack_number = syn.ack_number+1;
-  socket->init_win_size = syn.window;
-  socket->curr_win_size = syn.window;
-  socket->address = src_addr;
-  socket->address_len = src_addr_length;
+/* Recalculates the checksum of a header that is followed by opts_len bytes
+   of option blocks and data_len bytes of payload */
+static void set_segment_checksum (microtcp_header_t *nbo_header, const uint8_t *opts, size_t opts_len,
+                                  const uint8_t *data, size_t data_len)
+{
+  uint32_t crc;
 
-  //create header of SYNACK
-  synack = make_header(socket->seq_number, socket->ack_number, MICROTCP_WIN_SIZE, 0, 1, 0, 1, 0);
-  //synack.checksum = htonl(crc32(&synack, sizeof(synack)));
+  nbo_header->checksum = 0;
+  crc = update_crc32(0xffffffff, (const uint8_t *)nbo_header, sizeof(*nbo_header));
+  crc = update_crc32(crc, opts, opts_len);
+  crc = update_crc32(crc, data, data_len) ^ 0xffffffff;
+  nbo_header->checksum = htonl(crc);
+}
 
-  //send SYNACK
-  bytes_sent = sendto(socket->sd, &synack, sizeof(synack), MSG_CONFIRM, &socket->address, socket->address_len);
-  //check that SYNACK was successfully sent
-  if (bytes_sent != sizeof(synack))
-  {
-    socket->state = INVALID;
-    perror("none or not all bytes of synack were sent\n");
-    return socket->sd;
+/* Sends a header, its option blocks and its payload as a single datagram,
+   without copying the payload */
+static ssize_t send_segment (microtcp_sock_t *socket, microtcp_header_t *nbo_header,
+                             const uint8_t *opts, size_t opts_len,
+                             const uint8_t *data, size_t data_len)
+{
+  struct iovec iov[3];
+  struct msghdr msg;
+  struct cmsghdr *cmsg;
+  char cbuf[CMSG_SPACE(sizeof(int))];
+  ssize_t ret;
+  int n = 0;
+
+  if(socket->ts_enabled){
+    nbo_header->future_use1 = htonl(ts_now());
+    nbo_header->future_use2 = htonl(socket->ts_recent);
   }
-  socket->seq_number += 1;
-  socket->bytes_send += bytes_sent;
-  socket->packets_send += 1;
+  if(get_bit(ntohs(nbo_header->control), ACK_F))
+    socket->last_ack_sent = ntohl(nbo_header->ack_number);
+  set_segment_checksum(nbo_header, opts, opts_len, data, data_len);
 
-  do
-  {
-    ret = recvfrom(socket->sd, socket->recvbuf, MICROTCP_RECVBUF_LEN, MSG_WAITALL, &src_addr, &src_addr_length);
-  } while (!is_equal_addresses(socket->address, src_addr));
-  
-  //recvfrom failed
-  if (ret <= 0)
-  {
-    socket->state = INVALID;
-    perror("none or not all bytes of ACK were received\n");
-    return socket->sd;
+  iov[n].iov_base = nbo_header;
+  iov[n++].iov_len = sizeof(*nbo_header);
+  if(opts_len){
+    iov[n].iov_base = (void *)opts;
+    iov[n++].iov_len = opts_len;
+  }
+  if(data_len){
+    iov[n].iov_base = (void *)data;
+    iov[n++].iov_len = data_len;
   }
 
-  ack = get_hbo_header((microtcp_header_t *)socket->recvbuf);
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_name = &socket->address;
+  msg.msg_namelen = socket->address_len;
+  msg.msg_iov = iov;
+  msg.msg_iovlen = n;
 
-  if(!is_checksum_valid(socket->recvbuf, recv)){
-    perror("checksum is invalid");
-    socket->state = INVALID;
-    return socket->sd;
+  /* Data is ECN capable when the peer echoes marks and the congestion
+     control reacts to them */
+  if(data_len && socket->ecn_permitted && (socket->cc->flags & MICROTCP_CC_FLAG_ECN)){
+    memset(cbuf, 0, sizeof(cbuf));
+    msg.msg_control = cbuf;
+    msg.msg_controllen = sizeof(cbuf);
+    cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = IPPROTO_IP;
+    cmsg->cmsg_type = IP_TOS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    *(int *)CMSG_DATA(cmsg) = IPTOS_ECN_ECT0;
   }
 
-  //check ACK bit
-  if(!is_header_control_valid(&ack, 1, 0, 0, 0))
-  {
-    socket->state = INVALID;
-    perror("failed to accept connection\n");
-    return socket->sd;
+  ret = sendmsg(socket->sd, &msg, 0);
+  if(ret > 0){
+    socket->packets_send += 1;
+    socket->bytes_send += ret;
   }
-  socket->state = ESTABLISHED;
-  socket->ack_number = ack.seq_number+1;
-  
-  return socket->sd;
+  return ret;
 }
 
-int
-microtcp_shutdown (microtcp_sock_t *socket, int how)
+/* Splits a datagram in its header, option blocks and payload.
+   Returns 0 on success, -1 if the lengths do not add up */
+static int parse_segment (const uint8_t *buf, size_t len, rx_segment_t *seg)
 {
-  microtcp_header_t finack, ack;
+  const uint8_t *opts = buf + sizeof(microtcp_header_t);
+  uint32_t word[2];
+  size_t i;
+
+  seg->header = get_hbo_header((microtcp_header_t *)buf);
+  seg->sack_count = 0;
+
+  /* The option word of a SYN is a list of capabilities, not of blocks */
+  if(!get_bit(seg->header.control, SYN_F))
+    seg->sack_count = MICROTCP_OPT_SACK_COUNT(seg->header.future_use0);
+  if(seg->sack_count > MICROTCP_MAX_SACK_BLOCKS
+     || len < sizeof(microtcp_header_t) + seg->sack_count * sizeof(word))
+    return -1;
+  for(i = 0; i < seg->sack_count; i++){
+    memcpy(word, opts + i * sizeof(word), sizeof(word));
+    seg->sack[i].start = ntohl(word[0]);
+    seg->sack[i].end = ntohl(word[1]);
+  }
+
+  seg->data = opts + seg->sack_count * sizeof(word);
+  if(seg->header.data_len != len - (seg->data - buf))
+    return -1;
+  return 0;
+}
+
+/* Waits at most timeout_us for a valid segment of the connected peer.
+   A negative timeout blocks until a segment arrives.
+   Segments of other hosts and corrupted segments are silently dropped.
+   Whether the segment was CE marked is left in socket->rx_ce.
+   Returns the length of the segment, 0 on timeout and -1 on error */
+static ssize_t recv_segment (microtcp_sock_t *socket, uint8_t *buf, size_t len, int64_t timeout_us)
+{
+  struct pollfd pfd;
+  struct timespec ts;
+  struct sockaddr src_addr;
+  struct iovec iov;
+  struct msghdr msg;
+  struct cmsghdr *cmsg;
+  char cbuf[CMSG_SPACE(sizeof(int))];
+  uint64_t deadline = now_us() + (timeout_us > 0 ? timeout_us : 0);
+  int forever = timeout_us < 0;
+  uint64_t now;
   ssize_t ret;
-  uint32_t checksum_received, checksum_calculated;
 
-  if(how == SHUT_RDWR){
+  pfd.fd = socket->sd;
+  pfd.events = POLLIN;
 
-    //SEND FINACK, RECEIVE ACK
-    /* create FIN ACK segment */
-    finack = make_header(socket->seq_number, socket->ack_number, MICROTCP_WIN_SIZE, 0, 1, 0, 0, 1);
-    //finack.checksum = htonl(crc32(&finack, sizeof(finack)));
-    
-    /* send FIN ACK to client */
-    ret = sendto(socket->sd, &finack, sizeof(finack), 0, &socket->address, socket->address_len);
-    /* server creates FIN ACK segment */
+  while(1){
+    now = now_us();
+    if(now >= deadline)
+      timeout_us = 0;
+    else
+      timeout_us = deadline - now;
+    ts.tv_sec = timeout_us / 1000000;
+    ts.tv_nsec = (timeout_us % 1000000) * 1000;
 
-    /* if sendto returned error value or not all header bytes were sent return invalid socket */
-    if(ret != sizeof(finack))
-    {
-      socket->state = INVALID;
-      return socket->sd;
+    ret = ppoll(&pfd, 1, forever ? NULL : &ts, NULL);
+    if(ret < 0){
+      perror("waiting for segment");
+      return -1;
     }
+    if(ret == 0)
+      return 0;
 
-    /* wait to receive ACK from client */
-    ret = recvfrom(socket->sd, socket->recvbuf, MICROTCP_RECVBUF_LEN, MSG_WAITALL, &socket->address, &socket->address_len);
-    
-    /* if recvfrom returned error value or not all header bytes were received return invalid socket */
-    if(ret <= 0)
-    {
-      socket->state = INVALID;
-      return socket->sd;
+    iov.iov_base = buf;
+    iov.iov_len = len;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_name = &src_addr;
+    msg.msg_namelen = sizeof(src_addr);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = cbuf;
+    msg.msg_controllen = sizeof(cbuf);
+    ret = recvmsg(socket->sd, &msg, 0);
+    if(ret < 0){
+      perror("receiving segment");
+      return -1;
+    }
+    if(!is_equal_addresses(socket->address, src_addr))
+      continue;
+    if(!is_checksum_valid(buf, ret)){
+      socket->packets_lost += 1;
+      socket->bytes_lost += ret;
+      continue;
     }
+    socket->packets_received += 1;
+    socket->bytes_received += ret;
 
-    /* ACK header received in recv buffer */
-    //  checksum_received = ntohl(server_header->checksum);
-      
-    /* check if checksum is valid */
-    if(!is_checksum_valid(socket->recvbuf, ret))
-    {
-        socket->state = INVALID;
-        return socket->sd;
-      }
-    ack = get_hbo_header((microtcp_header_t *)socket->recvbuf);
+    socket->rx_ce = 0;
+    for(cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg))
+      if(cmsg->cmsg_level == IPPROTO_IP && cmsg->cmsg_type == IP_TOS)
+        socket->rx_ce = (*CMSG_DATA(cmsg) & IPTOS_ECN_MASK) == IPTOS_ECN_CE;
+    return ret;
+  }
+}
 
-    /* check that seq number and ack number are valid */
-    if(ack.seq_number != socket->ack_number || ack.ack_number != socket->seq_number
-    || !is_header_control_valid(&ack, 1, 0, 0, 0))
-    {
-      perror("error");
-      socket->state = INVALID;
-      return socket->sd;
-    }
-    socket->seq_number += 1;
 
-    //RECEIVE FINACK, SEND ACK
-    if(socket->state != CLOSING_BY_PEER){
+/* Fills blocks with the SACK blocks for the out-of-order data we hold.
+   The range that grew last goes first so that the sender learns about the
+   newest arrival even if older blocks do not fit. A pending DSACK goes
+   before all of them, followed by the range it lies in, if any.
+   Returns the number of blocks */
+static size_t build_sack_blocks (const microtcp_sock_t *socket, uint32_t *blocks)
+{
+  size_t i, n = 0, first = socket->ooo_last;
 
-      socket->state = CLOSING_BY_HOST;
-      
-      /* wait to receive FIN ACK */
-      ret = recvfrom(socket->sd, socket->recvbuf, MICROTCP_RECVBUF_LEN, MSG_WAITALL, &socket->address, &socket->address_len);
+  if(!socket->sack_permitted)
+    return 0;
+  if(socket->dsack_pending){
+    blocks[0] = htonl(socket->dsack_start);
+    blocks[1] = htonl(socket->dsack_end);
+    n = 1;
+    for(i = 0; i < socket->ooo_count; i++)
+      if(SEQ_GEQ(socket->dsack_start, socket->ooo_ranges[i].start)
+         && SEQ_LEQ(socket->dsack_end, socket->ooo_ranges[i].end))
+        first = i;
+  }
+  if(socket->ooo_count == 0)
+    return n;
 
-      if(ret<=0)
-      {
-        socket->state = INVALID;
-        return socket->sd;       
-      }
+  blocks[2 * n] = htonl(socket->ooo_ranges[first].start);
+  blocks[2 * n + 1] = htonl(socket->ooo_ranges[first].end);
+  n += 1;
+  for(i = 0; i < socket->ooo_count && n < MICROTCP_MAX_SACK_BLOCKS; i++){
+    if(i == first)
+      continue;
+    blocks[2 * n] = htonl(socket->ooo_ranges[i].start);
+    blocks[2 * n + 1] = htonl(socket->ooo_ranges[i].end);
+    n++;
+  }
+  return n;
+}
 
-      /* check if checksum is valid */
-      if(!is_checksum_valid(socket->recvbuf, ret)){
-        socket->state = INVALID;
-        return socket->sd;
-      }
+/* How long an ACK waits for more data: ack_delay_us at most. A quarter of
+   the RTT is enough to catch the next segment of a flight, and keeps a
+   small window from idling */
+static uint64_t delack_delay (const microtcp_sock_t *socket)
+{
+  uint64_t delay = socket->ack_delay_us;
 
-      finack = get_hbo_header((microtcp_header_t*)socket->recvbuf);
+  if(socket->rcv_rtt_us && socket->rcv_rtt_us / 4 < delay)
+    delay = socket->rcv_rtt_us / 4 > MICROTCP_CLOCK_GRANULARITY_US
+            ? socket->rcv_rtt_us / 4 : MICROTCP_CLOCK_GRANULARITY_US;
+  return delay;
+}
 
-      /* check that FIN and ACK bits are set to 1 */
-      if(finack.ack_number != socket->seq_number ||
-      !is_header_control_valid(&finack, 1,0,0,1)){
-        perror("error");
-        socket->state = INVALID;
-        return socket->sd;
-      }
+/* Adds to a header from make_header() the rest of what every segment
+   acknowledges: the echo of a CE mark and the SACK blocks, stored in
+   blocks. The segment carries any delayed ACK, which need not be sent
+   on its own any more. Returns the length of the blocks */
+static size_t ack_options (microtcp_sock_t *socket, microtcp_header_t *nbo_header, uint32_t *blocks)
+{
+  size_t nblocks;
 
-      socket->ack_number = finack.seq_number + 1;
+  if(socket->ce_echo)
+    nbo_header->control = htons(set_bit(ntohs(nbo_header->control), ECE_F));
+  nblocks = build_sack_blocks(socket, blocks);
+  nbo_header->future_use0 = htonl(nblocks);
+  socket->dsack_pending = 0;
+  socket->ack_pending = 0;
+  socket->delack_timer_us = 0;
+  return nblocks * 2 * sizeof(uint32_t);
+}
 
-      /* client creates ACK segment to send to server */
-      ack = make_header(socket->seq_number, socket->ack_number, MICROTCP_WIN_SIZE, 0, 1, 0, 0, 0);
-      //ack.checksum =  crc32(&ack, sizeof(ack));
+/* Sends a pure ACK carrying the cumulative ACK, the free receive window,
+   the SACK blocks and the echo of a CE mark */
+static int send_ack (microtcp_sock_t *socket)
+{
+  microtcp_header_t header;
+  uint32_t blocks[2 * MICROTCP_MAX_SACK_BLOCKS];
+  size_t opts_len;
 
-      /* send ACK to server */
-      ret = sendto(socket->sd, &ack, sizeof(ack), 0, &socket->address, socket->address_len);
-      
-      /* if sendto returned error value or not all header bytes were sent return invalid socket */
-      if(ret < 0){
-          socket->state = INVALID;
-          return socket->sd;
-      }
+  header = make_header(socket->seq_number, socket->ack_number, advertised_window(socket), 0, 1, 0, 0, 0);
+  opts_len = ack_options(socket, &header, blocks);
+  if(send_segment(socket, &header, (uint8_t *)blocks, opts_len, NULL, 0) != (ssize_t)(sizeof(header) + opts_len)){
+    perror("none or not all bytes of the ACK were sent");
+    return -1;
+  }
+  return 0;
+}
+
+/* The amount of data the sender is allowed to keep in flight */
+static size_t send_window (const microtcp_sock_t *socket)
+{
+  return socket->cwnd < socket->curr_win_size ? socket->cwnd : socket->curr_win_size;
+}
+
+/* Bytes of the send buffers of all the sockets of the process */
+static atomic_size_t sndbuf_mem;
+
+/* Bytes queued and not yet acknowledged */
+static size_t sndbuf_used (const microtcp_sock_t *socket)
+{
+  return (uint32_t)(socket->write_seq - socket->snd_una);
+}
+
+/* Send buffer auto-tuning, as Linux tcp_sndbuf_expand(): twice the
+   congestion window keeps the pipe full through a round of growth */
+static size_t sndbuf_limit (const microtcp_sock_t *socket)
+{
+  size_t limit = 2 * socket->cwnd;
+
+  if(!socket->sndbuf_auto)
+    return socket->sndbuf_len;
+  if(limit < socket->sndbuf_len)
+    limit = socket->sndbuf_len;
+  if(limit > MICROTCP_SNDBUF_AUTO_MAX)
+    limit = MICROTCP_SNDBUF_AUTO_MAX;
+  return limit;
+}
+
+/* Whether len more bytes fit the send buffer. An empty one always takes
+   a segment, so that a full process budget cannot stall the connection */
+static int sndbuf_has_room (const microtcp_sock_t *socket, size_t len)
+{
+  if(sndbuf_used(socket) == 0)
+    return 1;
+  return sndbuf_used(socket) + len <= sndbuf_limit(socket)
+         && atomic_load(&sndbuf_mem) + len <= MICROTCP_SNDBUF_MEM_MAX;
+}
+
+/* Appends a new segment with a copy of data_len bytes of data at the tail
+   of the retransmission queue and assigns it the next sequence numbers.
+   It has room for a full MSS, for the writes that follow to fill */
+static microtcp_segment_t *queue_segment (microtcp_sock_t *socket, const uint8_t *data, size_t data_len)
+{
+  microtcp_segment_t *seg;
+  size_t cap = data_len < socket->mss ? socket->mss : data_len;
+
+  seg = malloc(sizeof(microtcp_segment_t) + cap);
+  if(!seg){
+    perror("allocating segment");
+    return NULL;
+  }
+  seg->seq_number = socket->write_seq;
+  seg->data_len = data_len;
+  seg->data_cap = cap;
+  seg->data = (uint8_t *)(seg + 1);
+  memcpy(seg->data, data, data_len);
+  seg->sent_us = 0;
+  seg->retransmissions = 0;
+  seg->lost = 0;
+  seg->sacked = 0;
+  seg->next = NULL;
+
+  if(socket->rtx_tail)
+    socket->rtx_tail->next = seg;
+  else
+    socket->rtx_head = seg;
+  socket->rtx_tail = seg;
+  if(!socket->unsent_head)
+    socket->unsent_head = seg;
+  socket->write_seq += data_len;
+  atomic_fetch_add(&sndbuf_mem, data_len);
+  return seg;
+}
+
+/* Copies as much of buffer to the send buffer as fits, in segments of at
+   most one MSS. Small writes first fill the last segment if it was never
+   sent. Returns the number of bytes queued or -1 on failure */
+static ssize_t sndbuf_append (microtcp_sock_t *socket, const uint8_t *buffer, size_t length)
+{
+  microtcp_segment_t *tail = socket->rtx_tail;
+  size_t queued = 0, seg_len;
+
+  if(tail && tail->sent_us == 0 && tail->data_len < tail->data_cap && tail->data_len < socket->mss){
+    seg_len = (tail->data_cap < socket->mss ? tail->data_cap : socket->mss) - tail->data_len;
+    if(seg_len > length)
+      seg_len = length;
+    if(sndbuf_has_room(socket, seg_len)){
+      memcpy(tail->data + tail->data_len, buffer, seg_len);
+      tail->data_len += seg_len;
+      socket->write_seq += seg_len;
+      atomic_fetch_add(&sndbuf_mem, seg_len);
+      queued = seg_len;
     }
-    
-    socket->state = CLOSED;
-    free(socket->recvbuf);
-    return socket->sd;
   }
-  return socket->sd;
+
+  while(queued < length){
+    seg_len = length - queued;
+    if(seg_len > socket->mss)
+      seg_len = socket->mss;
+    if(!sndbuf_has_room(socket, seg_len))
+      break;
+    if(!queue_segment(socket, buffer + queued, seg_len))
+      return -1;
+    queued += seg_len;
+  }
+  return queued;
 }
 
-ssize_t
-microtcp_send (microtcp_sock_t *socket, const void *buffer, size_t length,
-               int flags)
+/* Releases every segment of the retransmission queue */
+static void free_rtx_queue (microtcp_sock_t *socket)
 {
-  /* Your code here */
+  microtcp_segment_t *seg;
+
+  atomic_fetch_sub(&sndbuf_mem, sndbuf_used(socket));
+  while((seg = socket->rtx_head)){
+    socket->rtx_head = seg->next;
+    free(seg);
+  }
+  socket->rtx_tail = NULL;
+  socket->unsent_head = NULL;
+  socket->snd_una = socket->write_seq;
+  socket->bytes_in_flight = 0;
+  socket->rtx_timer_us = 0;
+  socket->rack_timer_us = 0;
+  socket->tlp_timer_us = 0;
+  socket->tlp_active = 0;
 }
 
-ssize_t
-microtcp_recv (microtcp_sock_t *socket, void *buffer, size_t length, int flags)
+/* Tail loss probe (RFC 8985): when the last segments of a flight are lost
+   no duplicate ACK will ever come, so two SRTTs after the last new
+   transmission a probe is sent whose ACK or SACK reveals the loss to RACK.
+   The probe takes the place of the RTO if that would expire first, so a
+   tail loss costs no window collapse. A lone segment may wait for the
+   delayed ACK of the peer as well. It needs SACK and is not used during
+   recovery */
+static void tlp_arm (microtcp_sock_t *socket)
+{
+  uint64_t deadline;
+
+  socket->tlp_timer_us = 0;
+  if(!socket->sack_permitted || socket->in_recovery || socket->tlp_active
+     || microtcp_flight_size(socket) == 0 || socket->srtt_us == 0)
+    return;
+  deadline = now_us() + 2 * socket->srtt_us + MICROTCP_CLOCK_GRANULARITY_US;
+  if(microtcp_flight_size(socket) <= socket->mss)
+    deadline += socket->peer_ack_delay_us;
+  if(socket->rtx_timer_us && deadline > socket->rtx_timer_us)
+    deadline = socket->rtx_timer_us;
+  socket->tlp_timer_us = deadline;
+}
+
+/* The rate the pacing engine spreads segments at, in bytes per second:
+   the congestion control's if it has one, otherwise the window over the
+   SRTT with some headroom, more in slow start so that the window can
+   still double every round. 0 means no pacing */
+static uint64_t pacing_rate (const microtcp_sock_t *socket)
+{
+  uint64_t rate = 0;
+
+  if(socket->cc->pacing_rate)
+    rate = socket->cc->pacing_rate(socket);
+  if(rate == 0 && socket->srtt_us != 0)
+    rate = (uint64_t)socket->cwnd * 1000000 / socket->srtt_us
+           * (socket->cwnd < socket->ssthresh ? MICROTCP_PACING_SS_GAIN : MICROTCP_PACING_CA_GAIN) / 100;
+  return rate;
+}
+
+/* Whether pacing lets a segment leave now. A segment due within the
+   clock granularity goes at once, sleeping for less is not precise.
+   Otherwise the pacing timer is armed for when it is due */
+static int pacing_allows (microtcp_sock_t *socket)
+{
+  if(socket->pacing_next_us <= now_us() + MICROTCP_CLOCK_GRANULARITY_US)
+    return 1;
+  socket->pacing_timer_us = socket->pacing_next_us;
+  return 0;
+}
+
+/* (Re)transmits a queued segment. Returns 0 on success, -1 on failure */
+static int transmit_segment (microtcp_sock_t *socket, microtcp_segment_t *seg)
 {
-  /* Your code here */
+  microtcp_header_t header;
+  uint32_t blocks[2 * MICROTCP_MAX_SACK_BLOCKS];
+  size_t opts_len;
+  uint64_t rate;
+  ssize_t ret;
+
+  /* Data sent soon after data arrived is a reply: the peer's pushed
+     data may wait for the next one to carry its ACK */
+  if(seg->sent_us == 0 && socket->ack_freq > 1
+     && now_us() - socket->rcv_last_us < delack_delay(socket))
+    socket->pingpong = 1;
+
+  header = make_header(seg->seq_number, socket->ack_number,
+                       advertised_window(socket), seg->data_len, 1, 0, 0, 0);
+  /* The last data queued is pushed: the peer acknowledges it at once */
+  if(!seg->next)
+    header.control = htons(set_bit(ntohs(header.control), PSH_F));
+  opts_len = ack_options(socket, &header, blocks);
+  ret = send_segment(socket, &header, (uint8_t *)blocks, opts_len, seg->data, seg->data_len);
+  if(ret != (ssize_t)(sizeof(header) + opts_len + seg->data_len)){
+    perror("none or not all bytes of the segment were sent");
+    return -1;
+  }
+
+  if(seg->sent_us == 0){
+    socket->seq_number = seg->seq_number + seg->data_len;
+    socket->unsent_head = seg->next;
+  }
+  else{
+    seg->retransmissions += 1;
+    /* Remembered to tell later whether the retransmission was needed */
+    if(socket->undo_valid){
+      socket->undo_retrans += 1;
+      if(socket->undo_ts == 0 && socket->ts_enabled){
+        socket->undo_ts = ntohl(header.future_use1);
+        socket->undo_end_seq = seg->seq_number + seg->data_len;
+      }
+    }
+  }
+  seg->sent_us = now_us();
+  seg->lost = 0;
+  if(socket->in_recovery)
+    socket->prr_out += seg->data_len;
+
+  /* A new delivery interval starts when the pipe was empty */
+  if(socket->bytes_in_flight == 0){
+    socket->first_sent_us = seg->sent_us;
+    socket->delivered_us = seg->sent_us;
+  }
+  seg->tx_delivered = socket->delivered;
+  seg->tx_delivered_us = socket->delivered_us;
+  seg->tx_first_sent_us = socket->first_sent_us;
+  seg->tx_app_limited = socket->app_limited != 0;
+
+  /* The next segment leaves when this one would have at the pacing rate.
+     Idle time earns no credit for a burst */
+  rate = pacing_rate(socket);
+  if(rate){
+    if(socket->pacing_next_us < seg->sent_us)
+      socket->pacing_next_us = seg->sent_us;
+    socket->pacing_next_us += (sizeof(header) + seg->data_len) * 1000000 / rate;
+  }
+  socket->bytes_in_flight += seg->data_len;
+  if(socket->rtx_timer_us == 0)
+    socket->rtx_timer_us = seg->sent_us + socket->rto_us;
+  if(seg->retransmissions == 0)
+    tlp_arm(socket);
+  return 0;
+}
+
+/* Feeds a round trip time sample to the estimator and recalculates the
+   RTO, which leaves room for an ACK the peer delays. A fresh sample also
+   clears any exponential backoff */
+static void update_rtt (microtcp_sock_t *socket, uint64_t rtt_us)
+{
+  uint64_t delta;
+
+  if(socket->srtt_us == 0){
+    socket->srtt_us = rtt_us;
+    socket->rttvar_us = rtt_us / 2;
+  }
+  else{
+    delta = socket->srtt_us > rtt_us ? socket->srtt_us - rtt_us : rtt_us - socket->srtt_us;
+    socket->rttvar_us = (3 * socket->rttvar_us + delta) / 4;
+    socket->srtt_us = (7 * socket->srtt_us + rtt_us) / 8;
+  }
+
+  if(socket->min_rtt_us == 0 || rtt_us < socket->min_rtt_us)
+    socket->min_rtt_us = rtt_us;
+  socket->rto_us = socket->srtt_us
+                   + (4 * socket->rttvar_us > MICROTCP_CLOCK_GRANULARITY_US
+                      ? 4 * socket->rttvar_us : MICROTCP_CLOCK_GRANULARITY_US)
+                   + socket->peer_ack_delay_us;
+  if(socket->rto_us < socket->rto_min_us)
+    socket->rto_us = socket->rto_min_us;
+  if(socket->rto_us > socket->rto_max_us)
+    socket->rto_us = socket->rto_max_us;
+}
+
+/* Remembers the TSval to echo. Only segments that do not lie past the
+   last ACK sent count (RFC 7323), so that a delayed ACK echoes the oldest
+   segment it covers and the echo of an ACK for a hole that just filled
+   is the TSval of the segment that filled it */
+static void update_ts_recent (microtcp_sock_t *socket, const rx_segment_t *rx)
+{
+  if(socket->ts_enabled && SEQ_LEQ(rx->header.seq_number, socket->last_ack_sent))
+    socket->ts_recent = rx->header.future_use1;
+}
+
+/* Counts a segment the peer has just acknowledged or SACKed as delivered.
+   The most recently sent of those defines the delivery rate sample: the
+   data delivered since it was sent, over the time it took to send and to
+   acknowledge it, whichever is longer */
+static void rate_delivered (microtcp_sock_t *socket, const microtcp_segment_t *seg,
+                            microtcp_ack_sample_t *sample)
+{
+  uint64_t send_elapsed, ack_elapsed;
+
+  socket->delivered += seg->data_len;
+  socket->delivered_us = sample->now_us;
+  if(seg->sent_us == 0 || seg->tx_delivered < sample->prior_delivered)
+    return;
+
+  send_elapsed = seg->sent_us - seg->tx_first_sent_us;
+  ack_elapsed = sample->now_us - seg->tx_delivered_us;
+  sample->prior_delivered = seg->tx_delivered;
+  sample->interval_us = send_elapsed > ack_elapsed ? send_elapsed : ack_elapsed;
+  sample->is_app_limited = seg->tx_app_limited;
+  socket->first_sent_us = seg->sent_us;
+}
+
+/* Saves the window before a reduction, to restore it if the reduction
+   turns out to be spurious. A timeout during the recovery from an earlier
+   reduction keeps the window from before the first one */
+static void undo_save (microtcp_sock_t *socket, int is_rto)
+{
+  if(socket->undo_valid && SEQ_LT(socket->snd_una, socket->recover)){
+    socket->undo_rto |= is_rto;
+    return;
+  }
+  socket->undo_valid = 1;
+  socket->undo_rto = is_rto;
+  socket->undo_marker = socket->snd_una;
+  socket->undo_cwnd = socket->cwnd;
+  socket->undo_ssthresh = socket->ssthresh;
+  socket->undo_retrans = 0;
+  socket->undo_ts = 0;
+}
+
+/* The last reduction was spurious: the segments taken for lost were only
+   delayed or reordered. The window goes back to what it was. After a
+   timeout, which took everything in flight for lost, the segments still
+   waiting for retransmission are in flight after all. Losses fast recovery
+   found are left alone, they were detected one by one */
+static void undo_reduction (microtcp_sock_t *socket)
+{
+  microtcp_segment_t *seg;
+
+  socket->undo_valid = 0;
+  if(socket->cwnd < socket->undo_cwnd)
+    socket->cwnd = socket->undo_cwnd;
+  if(socket->ssthresh < socket->undo_ssthresh)
+    socket->ssthresh = socket->undo_ssthresh;
+  if(socket->cc->undo)
+    socket->cc->undo(socket);
+
+  socket->in_recovery = 0;
+  if(!socket->undo_rto)
+    return;
+  for(seg = socket->rtx_head; seg; seg = seg->next){
+    if(!seg->lost)
+      continue;
+    seg->lost = 0;
+    socket->bytes_in_flight += seg->data_len;
+  }
+}
+
+/* Whether the first SACK block of an ACK is a DSACK */
+static int is_dsack (const rx_segment_t *rx)
+{
+  if(SEQ_LEQ(rx->sack[0].end, rx->header.ack_number))
+    return 1;
+  return rx->sack_count > 1 && SEQ_GEQ(rx->sack[0].start, rx->sack[1].start)
+         && SEQ_LEQ(rx->sack[0].end, rx->sack[1].end);
+}
+
+/* A DSACK of data sent after the reduction means one of its
+   retransmissions was not needed. Returns 1 once all were reported so */
+static int dsack_received (microtcp_sock_t *socket, const rx_segment_t *rx)
+{
+  if(!socket->undo_valid || socket->undo_retrans == 0
+     || SEQ_LT(rx->sack[0].start, socket->undo_marker))
+    return 0;
+  socket->undo_retrans -= 1;
+  return socket->undo_retrans == 0;
+}
+
+/* Eifel detection (RFC 3522): the ACK of the first retransmission echoes
+   the timestamp of the original transmission if that one arrived after
+   all, and the retransmission was spurious */
+static void undo_check_eifel (microtcp_sock_t *socket, const rx_segment_t *rx)
+{
+  if(!socket->undo_valid || socket->undo_ts == 0
+     || SEQ_LT(rx->header.ack_number, socket->undo_end_seq))
+    return;
+  if(rx->header.future_use2 != 0 && SEQ_LT(rx->header.future_use2, socket->undo_ts))
+    undo_reduction(socket);
+  else
+    socket->undo_ts = 0;
+}
+
+/* RACK (RFC 8985) detects losses by time instead of by counting duplicate
+   ACKs: a segment is lost when one sent after it was delivered and more
+   than an RTT plus a reordering window has passed since it was sent. It
+   catches lost retransmissions and losses with too few segments behind
+   them for three duplicate ACKs. This remembers the most recently sent
+   segment the peer has delivered. Segments are passed in sequence order,
+   so one never retransmitted and delivered below the highest sequence
+   number delivered so far shows that the path reorders */
+static void rack_update (microtcp_sock_t *socket, const microtcp_segment_t *seg, uint64_t now)
+{
+  uint64_t rtt = now - seg->sent_us;
+  uint32_t end = seg->seq_number + seg->data_len;
+
+  if(SEQ_GT(end, socket->rack_fack))
+    socket->rack_fack = end;
+  else if(SEQ_LT(end, socket->rack_fack) && seg->retransmissions == 0)
+    socket->rack_reordering_seen = 1;
+  /* Faster than possible: the ACK is for the original transmission */
+  if(seg->retransmissions && rtt < socket->min_rtt_us)
+    return;
+  if(seg->sent_us > socket->rack_xmit_us
+     || (seg->sent_us == socket->rack_xmit_us && SEQ_GT(end, socket->rack_end_seq))){
+    socket->rack_xmit_us = seg->sent_us;
+    socket->rack_end_seq = end;
+    socket->rack_rtt_us = rtt;
+  }
+}
+
+/* A DSACK means a retransmission was not needed: the original was only
+   reordered and the reordering window was too short. It grows by a
+   quarter of the min RTT, at most once per round trip, and keeps its size
+   for the next 16 recoveries (RFC 8985 section 6.2) */
+static void rack_dsack (microtcp_sock_t *socket)
+{
+  socket->rack_reordering_seen = 1;
+  if(SEQ_LT(socket->snd_una, socket->rack_dsack_round))
+    return;
+  socket->rack_dsack_round = socket->seq_number;
+  socket->rack_reo_wnd_mult += 1;
+  socket->rack_reo_wnd_persist = 16;
+}
+
+/* A fast or RTO recovery ended. After 16 of them without a DSACK the
+   reordering window drops back to a quarter of the min RTT */
+static void rack_recovery_done (microtcp_sock_t *socket)
+{
+  if(socket->rack_reo_wnd_persist > 0 && --socket->rack_reo_wnd_persist == 0)
+    socket->rack_reo_wnd_mult = 1;
+}
+
+/* Updates the SACK scoreboard: segments inside a SACK block are out of
+   flight and will not be retransmitted. They are walked in sequence
+   order, whatever the order of the blocks */
+static void process_sack (microtcp_sock_t *socket, const rx_segment_t *rx,
+                          microtcp_ack_sample_t *sample)
+{
+  microtcp_segment_t *seg;
+  size_t i;
+
+  if(rx->sack_count && is_dsack(rx)){
+    rack_dsack(socket);
+    if(dsack_received(socket, rx))
+      undo_reduction(socket);
+  }
+  if(rx->sack_count == 0)
+    return;
+  for(seg = socket->rtx_head; seg && seg != socket->unsent_head; seg = seg->next){
+    if(seg->sacked)
+      continue;
+    for(i = 0; i < rx->sack_count; i++)
+      if(SEQ_GT(rx->sack[i].end, socket->snd_una) && SEQ_LEQ(rx->sack[i].end, socket->seq_number)
+         && SEQ_GEQ(seg->seq_number, rx->sack[i].start)
+         && SEQ_LEQ(seg->seq_number + seg->data_len, rx->sack[i].end))
+        break;
+    if(i == rx->sack_count)
+      continue;
+    if(!seg->lost && seg->sent_us != 0)
+      socket->bytes_in_flight -= seg->data_len;
+    rate_delivered(socket, seg, sample);
+    rack_update(socket, seg, sample->now_us);
+    seg->sacked = 1;
+    seg->lost = 0;
+  }
+}
+
+/* Takes a sent segment out of flight, so that fill_window() retransmits it */
+static void mark_lost (microtcp_sock_t *socket, microtcp_segment_t *seg)
+{
+  if(seg->lost || seg->sacked || seg->sent_us == 0)
+    return;
+  seg->lost = 1;
+  socket->bytes_in_flight -= seg->data_len;
+  socket->packets_lost += 1;
+  socket->bytes_lost += seg->data_len;
+}
+
+/* Proportional rate reduction (RFC 6937). During recovery cwnd is set on
+   every ACK to what is in flight plus the data this ACK allows to send.
+   While the pipe is above ssthresh, data is sent in proportion to what
+   the peer delivers, ssthresh / RecoverFS of it. Once below, it grows
+   back towards ssthresh no faster than slow start would. The sender
+   neither bursts when recovery starts nor falls silent for an RTT */
+static void prr_update (microtcp_sock_t *socket, size_t delivered_data)
+{
+  size_t pipe = socket->bytes_in_flight;
+  size_t sndcnt, limit;
+
+  /* Without SACK the segments behind duplicate ACKs are still counted in
+     flight, only the estimate says they left */
+  if(!socket->sack_permitted)
+    pipe = pipe > socket->prr_credited ? pipe - socket->prr_credited : 0;
+  socket->prr_delivered += delivered_data;
+
+  if(pipe > socket->ssthresh){
+    sndcnt = (socket->prr_delivered * socket->ssthresh + socket->recover_fs - 1) / socket->recover_fs;
+    sndcnt = sndcnt > socket->prr_out ? sndcnt - socket->prr_out : 0;
+  }
+  else{
+    limit = socket->prr_delivered > socket->prr_out ? socket->prr_delivered - socket->prr_out : 0;
+    if(limit < delivered_data)
+      limit = delivered_data;
+    limit += socket->mss;
+    sndcnt = socket->ssthresh - pipe;
+    if(sndcnt > limit)
+      sndcnt = limit;
+  }
+  socket->cwnd = socket->bytes_in_flight + sndcnt;
+}
+
+/* The reordering window (RFC 8985 section 6.2). Until the path was seen
+   reordering, a loss is taken at once during recovery and once
+   MICROTCP_DUPACK_THRESH segments were SACKed. Otherwise the window is
+   rack_reo_wnd_mult quarters of the min RTT, at most the SRTT */
+static uint64_t rack_reo_wnd (const microtcp_sock_t *socket)
+{
+  const microtcp_segment_t *seg;
+  uint64_t reo_wnd;
+  size_t sacked = 0;
+
+  if(!socket->rack_reordering_seen){
+    if(socket->in_recovery || SEQ_LT(socket->snd_una, socket->recover))
+      return 0;
+    for(seg = socket->rtx_head; seg && sacked < MICROTCP_DUPACK_THRESH; seg = seg->next)
+      sacked += seg->sacked;
+    if(sacked >= MICROTCP_DUPACK_THRESH)
+      return 0;
+  }
+  reo_wnd = socket->rack_reo_wnd_mult * socket->min_rtt_us / 4;
+  return reo_wnd < socket->srtt_us ? reo_wnd : socket->srtt_us;
+}
+
+/* Marks the segments RACK finds lost. Those still inside the reordering
+   window arm the RACK timer instead. Returns the number of segments
+   marked */
+static size_t rack_detect_loss (microtcp_sock_t *socket, uint64_t now)
+{
+  microtcp_segment_t *seg;
+  uint64_t reo_wnd, deadline, timer = 0;
+  size_t marked = 0;
+
+  if(!socket->sack_permitted || socket->rack_xmit_us == 0)
+    return 0;
+  reo_wnd = rack_reo_wnd(socket);
+
+  for(seg = socket->rtx_head; seg; seg = seg->next){
+    if(seg->sacked || seg->lost || seg->sent_us == 0)
+      continue;
+    /* Only segments sent before the delivered one */
+    if(seg->sent_us > socket->rack_xmit_us
+       || (seg->sent_us == socket->rack_xmit_us
+           && SEQ_GEQ(seg->seq_number + seg->data_len, socket->rack_end_seq)))
+      continue;
+    deadline = seg->sent_us + socket->rack_rtt_us + reo_wnd;
+    if(deadline <= now){
+      mark_lost(socket, seg);
+      marked += 1;
+    }
+    else if(timer == 0 || deadline < timer)
+      timer = deadline;
+  }
+  socket->rack_timer_us = timer;
+  return marked;
+}
+
+/* Enters fast recovery once a loss was detected: lets the congestion
+   control pick the new ssthresh and retransmits the oldest lost segment
+   at once, whatever the window allows */
+static int enter_recovery (microtcp_sock_t *socket, size_t delivered_data)
+{
+  microtcp_segment_t *seg;
+
+  undo_save(socket, 0);
+  if(socket->cc->on_loss)
+    socket->cc->on_loss(socket);
+  else
+    socket->ssthresh = microtcp_cc_halve(socket);
+  socket->in_recovery = 1;
+  socket->recover = socket->seq_number;
+  socket->recovery_start_us = now_us();
+  socket->recover_fs = microtcp_flight_size(socket);
+  socket->prr_delivered = 0;
+  socket->prr_out = 0;
+  /* Each duplicate ACK means a segment has left the network */
+  socket->prr_credited = socket->dup_acks * socket->mss;
+  socket->tlp_timer_us = 0;
+
+  for(seg = socket->rtx_head; seg && !seg->lost; seg = seg->next);
+  if(seg && transmit_segment(socket, seg) < 0)
+    return -1;
+  prr_update(socket, delivered_data);
+  return 0;
+}
+
+/* The ACK of a tail loss probe. If the probe was a retransmission and the
+   ACK echoes its timestamp rather than the original's, the probe repaired
+   a loss the congestion control never heard of, and it reacts now.
+   Without timestamps the loss is assumed */
+static void tlp_ack (microtcp_sock_t *socket, const rx_segment_t *rx)
+{
+  socket->tlp_active = 0;
+  if(!socket->tlp_retrans)
+    return;
+  if(socket->ts_enabled && SEQ_LT(rx->header.future_use2, socket->tlp_ts))
+    return;
+  if(socket->cc->on_loss)
+    socket->cc->on_loss(socket);
+  else
+    socket->ssthresh = microtcp_cc_halve(socket);
+  socket->cwnd = socket->ssthresh;
+}
+
+/* The bytes an ACK reports as newly received by the peer: cumulatively
+   acknowledged or SACKed. Without SACK a duplicate ACK is taken for one
+   segment, which the next cumulative ACK must not count again */
+static size_t ack_delivered_data (microtcp_sock_t *socket, uint64_t delivered, int is_dupack)
+{
+  size_t delivered_data = socket->delivered - delivered;
+
+  if(socket->sack_permitted)
+    return delivered_data;
+  if(is_dupack){
+    socket->prr_credited += socket->mss;
+    return socket->mss;
+  }
+  if(delivered_data > socket->prr_credited){
+    delivered_data -= socket->prr_credited;
+    socket->prr_credited = 0;
+  }
+  else{
+    socket->prr_credited -= delivered_data;
+    delivered_data = 0;
+  }
+  return delivered_data;
+}
+
+/* Handles an ACK: releases the cumulatively acknowledged segments,
+   updates the SACK scoreboard, runs fast retransmit/fast recovery and
+   opens the congestion window. Returns 0 on success, -1 if a
+   retransmission could not be sent */
+static int process_ack (microtcp_sock_t *socket, const rx_segment_t *rx)
+{
+  microtcp_segment_t *seg;
+  const microtcp_header_t *hbo_header = &rx->header;
+  uint32_t ack = hbo_header->ack_number;
+  uint32_t acked, trim;
+  uint64_t rtt_sent_us = 0, delivered = socket->delivered;
+  microtcp_ack_sample_t sample;
+  size_t window = (size_t)hbo_header->window << socket->snd_wscale;
+  int is_dupack;
+
+  /* Old ACKs carry stale window information */
+  if(SEQ_LT(ack, socket->snd_una) || SEQ_GT(ack, socket->seq_number))
+    return 0;
+
+  sample.prior_in_flight = socket->bytes_in_flight;
+  sample.rtt_us = 0;
+  sample.now_us = now_us();
+  sample.ece = get_bit(hbo_header->control, ECE_F) != 0;
+  sample.prior_delivered = 0;
+  sample.interval_us = 0;
+  sample.is_app_limited = 0;
+
+  /* A duplicate ACK neither carries anything nor moves the window */
+  is_dupack = ack == (uint32_t)socket->snd_una && microtcp_flight_size(socket) > 0
+              && hbo_header->data_len == 0 && !get_bit(hbo_header->control, FIN_F)
+              && window == socket->curr_win_size;
+
+  /* The peer answers, whatever its window */
+  socket->persist_probes = 0;
+  socket->curr_win_size = window;
+  if(window > socket->max_peer_win)
+    socket->max_peer_win = window;
+  if(socket->sack_permitted)
+    process_sack(socket, rx, &sample);
+  /* A data segment reporting new SACK blocks counts as a duplicate ACK
+     too (RFC 6675) */
+  if(ack == (uint32_t)socket->snd_una && hbo_header->data_len > 0
+     && microtcp_flight_size(socket) > 0 && socket->delivered != delivered)
+    is_dupack = 1;
+
+  if(ack == (uint32_t)socket->snd_una){
+    if(!is_dupack)
+      return 0;
+    socket->dup_acks += 1;
+    if(socket->in_recovery){
+      rack_detect_loss(socket, sample.now_us);
+      prr_update(socket, ack_delivered_data(socket, delivered, 1));
+      return 0;
+    }
+    /* After a timeout, duplicates of data sent before it are ignored */
+    if(!SEQ_GEQ(ack, socket->recover))
+      return 0;
+    /* With SACK, RACK alone finds the losses: until the path is seen
+       reordering its window closes after MICROTCP_DUPACK_THRESH SACKed
+       segments, which stands in for the duplicate ACK threshold */
+    if(socket->sack_permitted)
+      return rack_detect_loss(socket, sample.now_us)
+             ? enter_recovery(socket, socket->delivered - delivered) : 0;
+    if(socket->dup_acks != MICROTCP_DUPACK_THRESH)
+      return 0;
+    mark_lost(socket, socket->rtx_head);
+    return enter_recovery(socket, socket->mss);
+  }
+
+  acked = ack - (uint32_t)socket->snd_una;
+  /* Everything outstanding at a timeout is acknowledged */
+  if(!socket->in_recovery && SEQ_LT(socket->snd_una, socket->recover) && SEQ_GEQ(ack, socket->recover))
+    rack_recovery_done(socket);
+  /* The FIN takes a sequence number but no room in the send buffer */
+  atomic_fetch_sub(&sndbuf_mem, acked < sndbuf_used(socket) ? acked : sndbuf_used(socket));
+  socket->snd_una = ack;
+  socket->dup_acks = 0;
+  socket->rtx_backoff = 0;
+
+  while((seg = socket->rtx_head) && SEQ_LEQ(seg->seq_number + seg->data_len, ack)){
+    if(!seg->lost && !seg->sacked)
+      socket->bytes_in_flight -= seg->data_len;
+    if(!seg->sacked){
+      rate_delivered(socket, seg, &sample);
+      rack_update(socket, seg, sample.now_us);
+    }
+    /* Karn's rule: the ACK of a retransmitted segment is ambiguous */
+    if(seg->retransmissions == 0 && !seg->sacked)
+      rtt_sent_us = seg->sent_us;
+    socket->rtx_head = seg->next;
+    free(seg);
+  }
+  if(!socket->rtx_head)
+    socket->rtx_tail = NULL;
+
+  /* An echoed timestamp gives a sample even for retransmitted data. The
+     peer's clock when it acknowledged it, minus ours when we sent it, is
+     the one-way delay shifted by the clock offset */
+  sample.owd_valid = socket->ts_enabled && hbo_header->future_use2 != 0;
+  sample.owd_us = hbo_header->future_use1 - hbo_header->future_use2;
+  if(socket->ts_enabled && hbo_header->future_use2 != 0)
+    sample.rtt_us = (uint32_t)(ts_now() - hbo_header->future_use2);
+  else if(rtt_sent_us != 0)
+    sample.rtt_us = now_us() - rtt_sent_us;
+  if(sample.rtt_us != 0)
+    update_rtt(socket, sample.rtt_us);
+  /* New data was acknowledged: restart the retransmission timer */
+  socket->rtx_timer_us = microtcp_flight_size(socket) > 0 ? now_us() + socket->rto_us : 0;
+  undo_check_eifel(socket, rx);
+  if(socket->tlp_active && SEQ_GEQ(ack, socket->tlp_end_seq))
+    tlp_ack(socket, rx);
+  tlp_arm(socket);
+
+  /* The peer may have acknowledged only the beginning of a segment */
+  if(seg && SEQ_LT(seg->seq_number, ack)){
+    trim = ack - seg->seq_number;
+    seg->seq_number = ack;
+    seg->data += trim;
+    seg->data_len -= trim;
+    if(!seg->lost && !seg->sacked)
+      socket->bytes_in_flight -= trim;
+    if(!seg->sacked)
+      socket->delivered += trim;
+  }
+
+  /* The sample ends with this ACK. The application limited phase is over
+     once the data sent during it has been delivered */
+  if(socket->delivered != delivered)
+    sample.delivered = socket->delivered - sample.prior_delivered;
+  else
+    sample.delivered = 0;
+  if(socket->app_limited && socket->delivered > socket->app_limited)
+    socket->app_limited = 0;
+
+  sample.acked = acked;
+  sample.in_recovery = socket->in_recovery;
+  socket->cc->on_ack(socket, &sample);
+
+  if(!socket->in_recovery){
+    if(rack_detect_loss(socket, sample.now_us) && SEQ_GEQ(ack, socket->recover))
+      return enter_recovery(socket, socket->delivered - delivered);
+    return 0;
+  }
+
+  if(SEQ_GEQ(ack, socket->recover)){
+    /* Full ACK: leave recovery without bursting */
+    socket->in_recovery = 0;
+    rack_recovery_done(socket);
+    socket->cwnd = socket->bytes_in_flight + socket->mss;
+    if(socket->cwnd > socket->ssthresh)
+      socket->cwnd = socket->ssthresh;
+    tlp_arm(socket);
+    return 0;
+  }
+
+  /* Partial ACK: without SACK the next hole is lost too. Retransmit it
+     right away, unless it was already retransmitted during this recovery */
+  seg = socket->rtx_head;
+  if(socket->sack_permitted)
+    rack_detect_loss(socket, sample.now_us);
+  else if(seg && seg->sent_us != 0 && seg->sent_us < socket->recovery_start_us){
+    mark_lost(socket, seg);
+    if(transmit_segment(socket, seg) < 0)
+      return -1;
+  }
+  prr_update(socket, ack_delivered_data(socket, delivered, 0));
+  return 0;
+}
+
+/* The oldest segment was not acknowledged in time. Everything in flight
+   that the peer has not SACKed is considered lost, the RTO is backed off
+   and the congestion control restarts from a small window. After
+   MICROTCP_DATA_RETRIES timeouts in a row the connection is given up.
+   Returns 0 on success, -1 with errno set to ETIMEDOUT on giving up */
+static int retransmission_timeout (microtcp_sock_t *socket)
+{
+  microtcp_segment_t *seg;
+
+  /* The peer stopped answering: the connection is given up */
+  if(socket->rtx_backoff == MICROTCP_DATA_RETRIES){
+    free_rtx_queue(socket);
+    socket->state = INVALID;
+    errno = ETIMEDOUT;
+    return -1;
+  }
+  socket->rtx_backoff++;
+
+  socket->rto_us *= 2;
+  if(socket->rto_us > socket->rto_max_us)
+    socket->rto_us = socket->rto_max_us;
+  /* The retransmission of the oldest segment restarts the timer */
+  socket->rtx_timer_us = 0;
+
+  undo_save(socket, 1);
+  if(socket->cc->on_rto)
+    socket->cc->on_rto(socket);
+  else{
+    socket->ssthresh = microtcp_cc_halve(socket);
+    socket->cwnd = socket->mss;
+  }
+  socket->in_recovery = 0;
+  socket->dup_acks = 0;
+  socket->recover = socket->seq_number;
+  socket->rack_timer_us = 0;
+  socket->tlp_timer_us = 0;
+  socket->tlp_active = 0;
+
+  for(seg = socket->rtx_head; seg; seg = seg->next)
+    mark_lost(socket, seg);
+  return 0;
+}
+
+/* Sends the tail loss probe: a new segment if the send buffer holds one
+   and the peer window allows, the last segment sent otherwise */
+static int tlp_send_probe (microtcp_sock_t *socket)
+{
+  microtcp_segment_t *seg, *probe = socket->unsent_head;
+
+  socket->tlp_timer_us = 0;
+  if(probe && socket->bytes_in_flight + probe->data_len <= socket->curr_win_size)
+    socket->tlp_retrans = 0;
+  else{
+    probe = NULL;
+    for(seg = socket->rtx_head; seg != socket->unsent_head; seg = seg->next)
+      if(!seg->sacked)
+        probe = seg;
+    if(!probe)
+      return 0;
+    /* Not a loss: the segment just goes out once more */
+    if(!probe->lost && probe->sent_us != 0)
+      socket->bytes_in_flight -= probe->data_len;
+    socket->tlp_retrans = 1;
+  }
+
+  socket->tlp_active = 1;
+  socket->tlp_end_seq = socket->seq_number;
+  socket->tlp_ts = ts_now();
+  if(transmit_segment(socket, probe) < 0)
+    return -1;
+  socket->rtx_timer_us = now_us() + socket->rto_us;
+  return 0;
+}
+
+/* Sends a window probe: a pure ACK with a sequence number already
+   acknowledged, which the peer answers with its window. Like Linux it
+   carries no data, so it cannot be lost to a closed window.
+   Returns 0 on success, -1 on failure */
+static int send_window_probe (microtcp_sock_t *socket)
+{
+  microtcp_header_t header;
+  uint32_t blocks[2 * MICROTCP_MAX_SACK_BLOCKS];
+  size_t opts_len;
+
+  header = make_header(socket->snd_una - 1, socket->ack_number, advertised_window(socket), 0, 1, 0, 0, 0);
+  opts_len = ack_options(socket, &header, blocks);
+  if(send_segment(socket, &header, (uint8_t *)blocks, opts_len, NULL, 0) != (ssize_t)(sizeof(header) + opts_len)){
+    perror("none or not all bytes of the window probe were sent");
+    return -1;
+  }
+  return 0;
+}
+
+/* The persist timer: while the peer's window keeps data from leaving
+   with nothing in flight, probes go out at the RTO, doubled after every
+   probe up to the largest RTO. The backoff stops growing there, and is
+   compared before it is shifted so that the shift cannot overflow */
+static void persist_arm (microtcp_sock_t *socket)
+{
+  uint64_t interval = socket->rto_max_us;
+  uint64_t now = now_us();
+
+  if(socket->persist_timer_us)
+    return;
+  if(socket->persist_backoff < 64 && socket->rto_us <= socket->rto_max_us >> socket->persist_backoff){
+    interval = socket->rto_us << socket->persist_backoff;
+    socket->persist_backoff += 1;
+  }
+  socket->persist_timer_us = interval < UINT64_MAX - now ? now + interval : UINT64_MAX;
+}
+
+/* The earliest of the retransmission, RACK, tail loss probe, pacing,
+   cork, Nagle, delayed ACK and persist timers */
+static uint64_t next_timer (const microtcp_sock_t *socket)
+{
+  uint64_t deadline = socket->rtx_timer_us;
+
+  if(socket->persist_timer_us && (deadline == 0 || socket->persist_timer_us < deadline))
+    deadline = socket->persist_timer_us;
+  if(socket->delack_timer_us && (deadline == 0 || socket->delack_timer_us < deadline))
+    deadline = socket->delack_timer_us;
+  /* Once expired the cork and Nagle timers have done their job */
+  if(socket->cork_timer_us > now_us() && (deadline == 0 || socket->cork_timer_us < deadline))
+    deadline = socket->cork_timer_us;
+  if(socket->nagle_timer_us > now_us() && (deadline == 0 || socket->nagle_timer_us < deadline))
+    deadline = socket->nagle_timer_us;
+  if(socket->pacing_timer_us && (deadline == 0 || socket->pacing_timer_us < deadline))
+    deadline = socket->pacing_timer_us;
+  if(socket->rack_timer_us && (deadline == 0 || socket->rack_timer_us < deadline))
+    deadline = socket->rack_timer_us;
+  if(socket->tlp_timer_us && (deadline == 0 || socket->tlp_timer_us < deadline))
+    deadline = socket->tlp_timer_us;
+  return deadline;
+}
+
+/* Runs the timer that expired. The pacing, cork and Nagle timers need
+   nothing, the next fill_window() sends what they held back. Returns 0 on
+   success, -1 on failure */
+static int on_timer (microtcp_sock_t *socket)
+{
+  uint64_t now = now_us();
+
+  /* No reply came to carry the ACK */
+  if(socket->delack_timer_us && now >= socket->delack_timer_us){
+    socket->pingpong = 0;
+    return send_ack(socket);
+  }
+  if(socket->persist_timer_us && now >= socket->persist_timer_us){
+    socket->persist_timer_us = 0;
+    /* As for retransmissions, a peer that answers no probe is given up */
+    if(socket->persist_probes == MICROTCP_DATA_RETRIES){
+      free_rtx_queue(socket);
+      socket->state = INVALID;
+      errno = ETIMEDOUT;
+      return -1;
+    }
+    socket->persist_probes++;
+    if(send_window_probe(socket) < 0)
+      return -1;
+    persist_arm(socket);
+    return 0;
+  }
+  if(socket->tlp_timer_us && now >= socket->tlp_timer_us)
+    return tlp_send_probe(socket);
+  if(socket->rtx_timer_us && now >= socket->rtx_timer_us)
+    return retransmission_timeout(socket);
+  if(socket->rack_timer_us && now >= socket->rack_timer_us){
+    if(rack_detect_loss(socket, now) && !socket->in_recovery
+       && SEQ_GEQ(socket->snd_una, socket->recover))
+      return enter_recovery(socket, 0);
+  }
+  return 0;
+}
+
+/* Whether the last segment, never sent, waits for more data. A partial
+   one is held while corked, for at most MICROTCP_CORK_TIMEOUT_US, and by
+   Nagle's algorithm (RFC 896) while sent data is unacknowledged. The ACK
+   that empties the pipe releases it; MICROTCP_NAGLE_TIMEOUT_US bounds the
+   wait for an ACK that is late or delayed */
+static int nagle_hold (microtcp_sock_t *socket, const microtcp_segment_t *seg)
+{
+  if(seg->next || seg->data_len >= seg->data_cap || seg->data_len >= socket->mss)
+    return 0;
+  if(socket->cork){
+    if(socket->cork_timer_us == 0)
+      socket->cork_timer_us = now_us() + MICROTCP_CORK_TIMEOUT_US;
+    return now_us() < socket->cork_timer_us;
+  }
+  if(socket->nodelay || microtcp_flight_size(socket) == 0)
+    return 0;
+  if(socket->nagle_timer_us == 0)
+    socket->nagle_timer_us = now_us() + MICROTCP_NAGLE_TIMEOUT_US;
+  return now_us() < socket->nagle_timer_us;
+}
+
+/* Cuts a segment never sent after its first len bytes. The rest becomes
+   the next segment. Returns 0 on success, -1 on failure */
+static int split_segment (microtcp_sock_t *socket, microtcp_segment_t *seg, size_t len)
+{
+  microtcp_segment_t *rest;
+  size_t rest_len = seg->data_len - len;
+
+  rest = malloc(sizeof(microtcp_segment_t) + rest_len);
+  if(!rest){
+    perror("allocating segment");
+    return -1;
+  }
+  *rest = *seg;
+  rest->seq_number = seg->seq_number + len;
+  rest->data_len = rest_len;
+  rest->data_cap = rest_len;
+  rest->data = (uint8_t *)(rest + 1);
+  memcpy(rest->data, seg->data + len, rest_len);
+  seg->data_len = len;
+  seg->data_cap = len;
+  seg->next = rest;
+  if(socket->rtx_tail == seg)
+    socket->rtx_tail = rest;
+  return 0;
+}
+
+/* Whether the peer's window lets a segment never sent leave. With nothing
+   in flight a segment larger than the window is cut to it, if that is
+   at least half the largest window the peer offered (silly window
+   syndrome avoidance, RFC 9293 section 3.8.6.2.1). Otherwise the
+   sender waits for an ACK or a window update, or probes the window */
+static int peer_window_allows (microtcp_sock_t *socket, microtcp_segment_t *seg)
+{
+  size_t flight = microtcp_flight_size(socket);
+  size_t room = socket->curr_win_size > flight ? socket->curr_win_size - flight : 0;
+
+  if(seg->data_len <= room)
+    return 1;
+  if(flight > 0)
+    return 0;
+  if(room > 0 && room >= socket->max_peer_win / 2 && split_segment(socket, seg, room) == 0)
+    return 1;
+  persist_arm(socket);
+  return 0;
+}
+
+/* Fills the window: lost segments are retransmitted first and the rest of
+   the window is filled with the segments of the send buffer never sent.
+   Returns 0 on success, -1 on failure */
+static int fill_window (microtcp_sock_t *socket)
+{
+  microtcp_segment_t *seg;
+  int held = 0, closed = 0;
+
+  socket->pacing_timer_us = 0;
+  for(seg = socket->rtx_head; seg; seg = seg->next){
+    if(!seg->lost)
+      continue;
+    if(socket->bytes_in_flight > 0
+       && socket->bytes_in_flight + seg->data_len > send_window(socket))
+      return 0;
+    if(!pacing_allows(socket))
+      return 0;
+    if(transmit_segment(socket, seg) < 0)
+      return -1;
+  }
+
+  while((seg = socket->unsent_head)){
+    /* With nothing in flight one segment is always allowed by the
+       congestion window */
+    if(socket->bytes_in_flight > 0
+       && socket->bytes_in_flight + seg->data_len > send_window(socket))
+      break;
+    if(nagle_hold(socket, seg)){
+      held = 1;
+      break;
+    }
+    if(!peer_window_allows(socket, seg)){
+      closed = 1;
+      break;
+    }
+    if(!pacing_allows(socket))
+      return 0;
+    if(transmit_segment(socket, seg) < 0)
+      return -1;
+  }
+  if(!held){
+    socket->cork_timer_us = 0;
+    socket->nagle_timer_us = 0;
+  }
+  if(!closed || microtcp_flight_size(socket) > 0){
+    socket->persist_timer_us = 0;
+    socket->persist_backoff = 0;
+  }
+
+  /* Out of data with room left in the window: the delivery rate the
+     next samples measure is the application's, not the network's */
+  if((held || !socket->unsent_head) && socket->bytes_in_flight < send_window(socket))
+    socket->app_limited = socket->delivered + socket->bytes_in_flight
+                          ? socket->delivered + socket->bytes_in_flight : 1;
+  return 0;
+}
+
+/* Records that [start, end) is held in the receive buffer, merging it with
+   the ranges it overlaps or touches. Returns -1 if there is no room left
+   for a new range */
+static int ooo_insert (microtcp_sock_t *socket, uint32_t start, uint32_t end)
+{
+  microtcp_range_t *r = socket->ooo_ranges;
+  size_t i, j;
+
+  /* First range that ends at or after the new one starts */
+  for(i = 0; i < socket->ooo_count && SEQ_LT(r[i].end, start); i++);
+
+  if(i == socket->ooo_count || SEQ_LT(end, r[i].start)){
+    if(socket->ooo_count == MICROTCP_MAX_OOO_RANGES)
+      return -1;
+    memmove(&r[i + 1], &r[i], (socket->ooo_count - i) * sizeof(*r));
+    r[i].start = start;
+    r[i].end = end;
+    socket->ooo_count += 1;
+    socket->ooo_last = i;
+    return 0;
+  }
+
+  /* Overlaps r[i]; swallow every following range it reaches */
+  if(SEQ_LT(start, r[i].start))
+    r[i].start = start;
+  for(j = i + 1; j < socket->ooo_count && SEQ_LEQ(r[j].start, end); j++);
+  if(SEQ_LT(end, r[j - 1].end))
+    end = r[j - 1].end;
+  if(SEQ_GT(end, r[i].end))
+    r[i].end = end;
+  memmove(&r[i + 1], &r[j], (socket->ooo_count - j) * sizeof(*r));
+  socket->ooo_count -= j - i - 1;
+  socket->ooo_last = i;
+  return 0;
+}
+
+/* Remembers a duplicate segment for the next ACK. Only the most recent
+   one is reported */
+static void dsack_note (microtcp_sock_t *socket, uint32_t start, uint32_t end)
+{
+  if(!socket->sack_permitted)
+    return;
+  socket->dsack_pending = 1;
+  socket->dsack_start = start;
+  socket->dsack_end = end;
+}
+
+/* Stores a data segment in the receive buffer at the offset of its sequence
+   number and hands every byte that became contiguous to the application */
+static void reassemble (microtcp_sock_t *socket, uint32_t seq, const uint8_t *data, size_t len)
+{
+  uint32_t ack = socket->ack_number;
+  uint32_t end = seq + len;
+  uint32_t advance;
+  size_t i;
+
+  /* Drop what was already received, telling the sender with a DSACK */
+  if(SEQ_LEQ(end, ack)){
+    dsack_note(socket, seq, end);
+    return;
+  }
+  if(SEQ_LT(seq, ack)){
+    dsack_note(socket, seq, ack);
+    data += ack - seq;
+    seq = ack;
+  }
+  /* Only data that fits in the ring is kept */
+  if((uint32_t)(end - ack) > recvbuf_free(socket)){
+    if((uint32_t)(seq - ack) >= recvbuf_free(socket))
+      return;
+    end = ack + recvbuf_free(socket);
+  }
+  for(i = 0; i < socket->ooo_count; i++)
+    if(SEQ_GEQ(seq, socket->ooo_ranges[i].start) && SEQ_LEQ(end, socket->ooo_ranges[i].end)){
+      dsack_note(socket, seq, end);
+      return;
+    }
+  /* In-order data short of the first out-of-order range needs no range
+     of its own, which keeps it from being dropped when the list is full */
+  if(seq == ack && (socket->ooo_count == 0 || SEQ_LT(end, socket->ooo_ranges[0].start))){
+    recvbuf_write(socket, socket->recvbuf_tail, data, end - seq);
+    socket->recvbuf_tail += end - seq;
+    socket->ack_number += end - seq;
+    return;
+  }
+  if(ooo_insert(socket, seq, end) < 0)
+    return;
+  recvbuf_write(socket, socket->recvbuf_tail + (seq - ack), data, end - seq);
+
+  if(socket->ooo_count == 0 || socket->ooo_ranges[0].start != ack)
+    return;
+  advance = socket->ooo_ranges[0].end - ack;
+  socket->recvbuf_tail += advance;
+  socket->ack_number += advance;
+  memmove(&socket->ooo_ranges[0], &socket->ooo_ranges[1],
+          (socket->ooo_count - 1) * sizeof(microtcp_range_t));
+  socket->ooo_count -= 1;
+  if(socket->ooo_last > 0)
+    socket->ooo_last -= 1;
+}
+
+/* The delayed ACK option of our SYN, see MICROTCP_OPT_DELACK */
+static uint32_t delack_option (const microtcp_sock_t *socket)
+{
+  uint32_t delay_ms = socket->ack_freq > 1 ? (socket->ack_delay_us + 999) / 1000 : 0;
+
+  return MICROTCP_OPT_DELACK | (uint32_t)socket->ack_freq << 12 | delay_ms << 16;
+}
+
+/* Agrees on delayed ACKs with the option word of the peer's SYN */
+static void delack_agree (microtcp_sock_t *socket, uint32_t options)
+{
+  uint8_t freq = MICROTCP_OPT_ACK_FREQ(options);
+
+  if(!(options & MICROTCP_OPT_DELACK)){
+    socket->ack_freq = 1;
+    socket->peer_ack_delay_us = 0;
+    return;
+  }
+  if(freq < socket->ack_freq)
+    socket->ack_freq = freq > 0 ? freq : 1;
+  socket->peer_ack_delay_us = socket->ack_freq > 1 ? MICROTCP_OPT_ACK_DELAY_MS(options) * 1000 : 0;
+}
+
+/* Sends a SYN, SYN-ACK or FIN and waits for the segment is_reply()
+   accepts as its answer, skipping any other. Unanswered, the segment is
+   resent when the RTO expires, with the RTO doubled every time, up to
+   MICROTCP_CONTROL_RETRIES times. Leaves the answer in buf and returns
+   its length, 0 with errno set to ETIMEDOUT if none came and -1 on error */
+static ssize_t control_exchange (microtcp_sock_t *socket, microtcp_header_t *nbo_header,
+                                 uint8_t *buf, size_t len,
+                                 int (*is_reply) (const microtcp_sock_t *socket,
+                                                  const microtcp_header_t *hbo_header))
+{
+  microtcp_header_t reply;
+  uint64_t rto = socket->rto_us, deadline;
+  ssize_t ret;
+  int tries;
+
+  for(tries = 0; tries <= MICROTCP_CONTROL_RETRIES; tries++){
+    /* A resent SYN carries a new TSval, so that the echo in the SYN-ACK
+       times one round trip */
+    if(get_bit(ntohs(nbo_header->control), SYN_F) && !socket->ts_enabled)
+      nbo_header->future_use1 = htonl(ts_now());
+    if(send_segment(socket, nbo_header, NULL, 0, NULL, 0) != sizeof(*nbo_header)){
+      perror("none or not all bytes of the control segment were sent");
+      return -1;
+    }
+
+    deadline = now_us() + rto;
+    while(now_us() < deadline){
+      ret = recv_segment(socket, buf, len, deadline - now_us());
+      if(ret < 0)
+        return -1;
+      if(ret == 0)
+        break;
+      reply = get_hbo_header((microtcp_header_t *)buf);
+      if(is_reply(socket, &reply))
+        return ret;
+    }
+    rto = 2 * rto < socket->rto_max_us ? 2 * rto : socket->rto_max_us;
+  }
+  errno = ETIMEDOUT;
+  return 0;
+}
+
+/* The SYN-ACK answering our SYN */
+static int is_synack (const microtcp_sock_t *socket, const microtcp_header_t *hbo_header)
+{
+  return is_header_control_valid(hbo_header, 1, 0, 1, 0)
+         && hbo_header->ack_number == (uint32_t)socket->seq_number;
+}
+
+/* A segment acknowledging everything we sent: the ACK completing the
+   handshake, or data overtaking it, or the ACK of our FIN */
+static int is_ack_of_all (const microtcp_sock_t *socket, const microtcp_header_t *hbo_header)
+{
+  return is_header_control_valid(hbo_header, 1, 0, 0, 0)
+         && hbo_header->ack_number == (uint32_t)socket->seq_number;
+}
+
+int
+microtcp_connect (microtcp_sock_t *socket, const struct sockaddr *address,
+                  socklen_t address_len)
+{
+  microtcp_header_t syn, synack, ack;
+  ssize_t bytes_sent, ret;
+  uint8_t tmp_buf[MICROTCP_MAX_SEGMENT];
+
+  srand(time(NULL));
+  socket->seq_number = rand();  // create random sequence number
+
+  /* create the header for the 1st step of the 3-way handshake (SYN segment) */
+  syn = make_header(socket->seq_number, 0, syn_window(socket), 0, 0, 0, 1, 0);
+  /* advertise the extensions we support */
+  socket->rcv_wscale = wscale_for(recvbuf_max(socket));
+  syn.future_use0 = htonl(MICROTCP_OPT_SACK_PERMITTED | MICROTCP_OPT_TIMESTAMPS
+                          | (socket->ecn_permitted ? MICROTCP_OPT_ECN : 0)
+                          | MICROTCP_OPT_WSCALE | (uint32_t)socket->rcv_wscale << 8 | delack_option(socket));
+  /* The SYN consumes one sequence number */
+  socket->seq_number += 1;
+  socket->address = *address;
+  socket->address_len = address_len;
+
+  //send the SYN until the SYNACK from the specific address arrives
+  ret = control_exchange(socket, &syn, tmp_buf, sizeof(tmp_buf), is_synack);
+  if(ret <= 0){
+    socket->state = INVALID;
+    return socket->sd;
+  }
+  synack = get_hbo_header((microtcp_header_t *)tmp_buf);
+
+  //received valid SYNACK
+  if(alloc_recvbuf(socket) < 0){
+    socket->state = INVALID;
+    return socket->sd;
+  }
+  socket->state = ESTABLISHED;  
+  socket->ack_number = synack.seq_number + 1;
+  socket->init_win_size = synack.window;
+  socket->curr_win_size = synack.window;
+  socket->sack_permitted = (synack.future_use0 & MICROTCP_OPT_SACK_PERMITTED) != 0;
+  socket->ts_enabled = (synack.future_use0 & MICROTCP_OPT_TIMESTAMPS) != 0;
+  socket->ecn_permitted = socket->ecn_permitted && (synack.future_use0 & MICROTCP_OPT_ECN);
+  delack_agree(socket, synack.future_use0);
+  if(synack.future_use0 & MICROTCP_OPT_WSCALE)
+    socket->snd_wscale = MICROTCP_OPT_WSCALE_SHIFT(synack.future_use0);
+  else
+    socket->rcv_wscale = 0;
+  if(socket->snd_wscale > MICROTCP_MAX_WSCALE)
+    socket->snd_wscale = MICROTCP_MAX_WSCALE;
+  if(socket->ts_enabled){
+    socket->ts_recent = synack.future_use1;
+    if(synack.future_use2 != 0)
+      update_rtt(socket, (uint32_t)(ts_now() - synack.future_use2));
+  }
+
+  //make header of last ack
+  ack = make_header(socket->seq_number, socket->ack_number, advertised_window(socket), 0, 1, 0, 0, 0);
+  //ack->checksum = crc32(&synack, sizeof(synack)); //add checksum
+
+  //send last ack, like every segment of the connection
+  bytes_sent = send_segment(socket, &ack, NULL, 0, NULL, 0);
+  if(bytes_sent != sizeof(ack)){
+    socket->state = INVALID;
+    perror("none or not all ack bytes were sent");
+    return socket->sd;
+  } 
+  socket->seq_number += 1; 
+  socket->last_ack_sent = socket->ack_number;
+  socket->snd_una = socket->seq_number;
+  socket->write_seq = socket->seq_number;
+  socket->recover = socket->seq_number;
+  socket->rack_fack = socket->seq_number;
+  socket->rack_dsack_round = socket->seq_number;
+
+  return socket->sd;
+}
+
+
+/* microtcp.h: microtcp_access returns 0 on success */
+
+int
+microtcp_accept (microtcp_sock_t *socket, struct sockaddr *address,
+                 socklen_t address_len)
+{
+  microtcp_header_t syn, synack, ack;
+  struct sockaddr src_addr;
+  socklen_t src_addr_length;
+  ssize_t ret;
+  uint8_t segbuf[MICROTCP_MAX_SEGMENT];
+  rx_segment_t rx;
+
+  if(alloc_recvbuf(socket) < 0){
+    socket->state = INVALID;
+    return -1;
+  }
+  socket->init_win_size = socket->recvbuf_len;
+  socket->curr_win_size = socket->recvbuf_len;
+
+  //receive SYN segment from any address. A corrupted one is dropped
+  //like any other segment, the peer sends its SYN again
+  do
+  {
+    src_addr_length = sizeof(src_addr);
+    ret = recvfrom(socket->sd, segbuf, sizeof(segbuf), MSG_WAITALL, &src_addr, &src_addr_length);
+    if (ret > 0)
+      syn = get_hbo_header((microtcp_header_t *)segbuf);
+  } while (ret < (ssize_t)sizeof(microtcp_header_t) || !is_checksum_valid(segbuf, ret)
+           || !is_header_control_valid(&syn, 0, 0, 1, 0));
+
+  //received valid SYN segment
+  srand(time(NULL));
+  socket->seq_number = rand(); //create random sequence number
+  socket->ack_number = syn.seq_number+1;
+  socket->init_win_size = syn.window;
+  socket->curr_win_size = syn.window;
+  socket->address = src_addr;
+  socket->address_len = src_addr_length;
+  if (address)
+    memcpy(address, &src_addr, address_len < src_addr_length ? address_len : src_addr_length);
+
+  //create header of SYNACK, agreeing on the extensions both ends support
+  synack = make_header(socket->seq_number, socket->ack_number, syn_window(socket), 0, 1, 0, 1, 0);
+  socket->sack_permitted = (syn.future_use0 & MICROTCP_OPT_SACK_PERMITTED) != 0;
+  socket->ts_enabled = (syn.future_use0 & MICROTCP_OPT_TIMESTAMPS) != 0;
+  socket->ecn_permitted = socket->ecn_permitted && (syn.future_use0 & MICROTCP_OPT_ECN);
+  delack_agree(socket, syn.future_use0);
+  if(syn.future_use0 & MICROTCP_OPT_WSCALE){
+    socket->snd_wscale = MICROTCP_OPT_WSCALE_SHIFT(syn.future_use0);
+    if(socket->snd_wscale > MICROTCP_MAX_WSCALE)
+      socket->snd_wscale = MICROTCP_MAX_WSCALE;
+    socket->rcv_wscale = wscale_for(recvbuf_max(socket));
+  }
+  synack.future_use0 = htonl((socket->sack_permitted ? MICROTCP_OPT_SACK_PERMITTED : 0)
+                             | (socket->ts_enabled ? MICROTCP_OPT_TIMESTAMPS : 0)
+                             | (socket->ecn_permitted ? MICROTCP_OPT_ECN : 0)
+                             | (syn.future_use0 & MICROTCP_OPT_WSCALE
+                                ? MICROTCP_OPT_WSCALE | (uint32_t)socket->rcv_wscale << 8 : 0)
+                             | (syn.future_use0 & MICROTCP_OPT_DELACK ? delack_option(socket) : 0));
+  if(socket->ts_enabled){
+    socket->ts_recent = syn.future_use1;
+    synack.future_use1 = htonl(ts_now());
+    synack.future_use2 = htonl(socket->ts_recent);
+  }
+  /* The SYNACK consumes one sequence number */
+  socket->seq_number += 1;
+
+  //send the SYNACK until the ACK arrives
+  ret = control_exchange(socket, &synack, segbuf, sizeof(segbuf), is_ack_of_all);
+  if (ret <= 0)
+  {
+    socket->state = INVALID;
+    perror("failed to accept connection\n");
+    return -1;
+  }
+  ack = get_hbo_header((microtcp_header_t *)segbuf);
+
+  socket->state = ESTABLISHED;
+  /* The ACK of the handshake consumes one sequence number. It may be
+     overtaken by the first data segment, which then completes the handshake */
+  socket->ack_number = syn.seq_number+2;
+  socket->last_ack_sent = socket->ack_number;
+  socket->curr_win_size = (size_t)ack.window << socket->snd_wscale;
+  socket->snd_una = socket->seq_number;
+  socket->write_seq = socket->seq_number;
+  socket->recover = socket->seq_number;
+  socket->rack_fack = socket->seq_number;
+  socket->rack_dsack_round = socket->seq_number;
+  if(parse_segment(segbuf, ret, &rx) == 0){
+    update_ts_recent(socket, &rx);
+    if(ack.data_len > 0)
+      reassemble(socket, rx.header.seq_number, rx.data, rx.header.data_len);
+  }
+  
+  return 0;
+}
+
+/* Feeds the receiver's RTT estimate. With timestamps a segment echoes the
+   TSval of an ACK, otherwise the time to receive a whole window bounds
+   the RTT from above. Lower samples weigh more: a sender pausing must
+   not stretch the auto-tuning rounds */
+static void rcv_rtt_measure (microtcp_sock_t *socket, const rx_segment_t *rx)
+{
+  uint64_t now = now_us();
+  uint64_t sample;
+
+  if(socket->ts_enabled){
+    if(rx->header.future_use2 == 0)
+      return;
+    sample = (uint32_t)(ts_now() - rx->header.future_use2);
+  }
+  else{
+    if(socket->rcv_rtt_stamp_us != 0 && SEQ_LT(socket->ack_number, socket->rcv_rtt_seq))
+      return;
+    sample = socket->rcv_rtt_stamp_us ? now - socket->rcv_rtt_stamp_us : 0;
+    socket->rcv_rtt_stamp_us = now;
+    socket->rcv_rtt_seq = socket->ack_number + recvbuf_free(socket);
+    if(sample == 0)
+      return;
+  }
+  if(socket->rcv_rtt_us == 0 || sample < socket->rcv_rtt_us)
+    socket->rcv_rtt_us = sample;
+  else
+    socket->rcv_rtt_us += (sample - socket->rcv_rtt_us) / 8;
+}
+
+/* Acknowledges a data segment. Unless it must be at once, the ACK is
+   delayed until ack_freq segments arrived (RFC 5681 section 4.2), for at
+   most delack_delay(). Returns 0 on success, -1 on failure */
+static int ack_data (microtcp_sock_t *socket, int immediate)
+{
+  socket->ack_pending += 1;
+  if(immediate || socket->ack_pending >= socket->ack_freq)
+    return send_ack(socket);
+  if(socket->delack_timer_us == 0)
+    socket->delack_timer_us = now_us() + delack_delay(socket);
+  return 0;
+}
+
+/* Handles a segment received on an established connection.
+   In-order data is appended to the receive ring and acknowledged.
+   Returns 0 on success, -1 if the connection broke */
+static int process_segment (microtcp_sock_t *socket, const uint8_t *segbuf, size_t len)
+{
+  rx_segment_t rx;
+  microtcp_header_t header;
+  int in_order, fits;
+
+  if(parse_segment(segbuf, len, &rx) < 0)
+    return 0;
+  header = rx.header;
+  if(is_header_control_valid(&header, 0, 1, 0, 0)){
+    socket->state = INVALID;
+    return -1;
+  }
+  update_ts_recent(socket, &rx);
+
+  if(is_header_control_valid(&header, 1, 0, 0, 0) && process_ack(socket, &rx) < 0){
+    socket->state = INVALID;
+    return -1;
+  }
+
+  if(header.data_len > 0){
+    /* When the CE mark changes the delayed ACK leaves first, so that the
+       echo tells the sender exactly which data was marked (RFC 8257) */
+    if(socket->ack_pending && socket->ce_echo != socket->rx_ce && send_ack(socket) < 0)
+      return -1;
+    socket->ce_echo = socket->rx_ce;
+    socket->rcv_last_us = now_us();
+    /* Out-of-order data is held until the gap before it fills. Either way
+       the ACK tells the sender the next byte missing, at once */
+    in_order = header.seq_number == (uint32_t)socket->ack_number && socket->ooo_count == 0;
+    /* Data the ring had no room for is reported at once too */
+    fits = (uint32_t)(header.seq_number + header.data_len - socket->ack_number) <= recvbuf_free(socket);
+    reassemble(socket, header.seq_number, rx.data, header.data_len);
+    rcv_rtt_measure(socket, &rx);
+    return ack_data(socket, !in_order || !fits || socket->ooo_count > 0 || socket->dsack_pending
+                            || (get_bit(header.control, PSH_F) && !socket->pingpong));
+  }
+
+  if(is_header_control_valid(&header, 0, 0, 0, 1)
+     && header.seq_number == (uint32_t)socket->ack_number){
+    socket->ack_number += 1;
+    socket->state = CLOSING_BY_PEER;
+    return send_ack(socket);
+  }
+
+  /* A segment from before the next byte expected is a window probe, and
+     its ACK tells the peer the window (RFC 9293 section 3.10.7.4) */
+  if(!get_bit(header.control, FIN_F) && SEQ_LT(header.seq_number, socket->ack_number))
+    return send_ack(socket);
+  return 0;
+}
+
+/* Receive buffer auto-tuning (dynamic right sizing, like Linux
+   tcp_rcv_space_adjust()). Once per receiver RTT the ring grows to twice
+   what the application read in that RTT, so that the window keeps ahead
+   of a sender that doubles its rate every RTT */
+static void recvbuf_autotune (microtcp_sock_t *socket)
+{
+  uint64_t now = now_us();
+  size_t copied, target;
+
+  if(!socket->rcvbuf_auto || socket->rcv_rtt_us == 0)
+    return;
+  if(socket->rcvq_stamp_us == 0 || now - socket->rcvq_stamp_us >= socket->rcv_rtt_us){
+    copied = socket->recvbuf_head - socket->rcvq_head;
+    if(socket->rcvq_stamp_us != 0){
+      target = round_pow2(2 * copied);
+      if(target > MICROTCP_RCVBUF_AUTO_MAX)
+        target = MICROTCP_RCVBUF_AUTO_MAX;
+      if(target > socket->recvbuf_len)
+        recvbuf_resize(socket, target);
+    }
+    socket->rcvq_head = socket->recvbuf_head;
+    socket->rcvq_stamp_us = now;
+  }
+}
+
+/* When the grown ring of an idle connection shrinks back, 0 if it does not */
+static uint64_t recvbuf_idle_deadline (const microtcp_sock_t *socket)
+{
+  if(!socket->rcvbuf_auto || socket->recvbuf_len <= MICROTCP_RECVBUF_LEN
+     || socket->recvbuf_tail != socket->recvbuf_head || socket->ooo_count > 0)
+    return 0;
+  return socket->rcv_last_us + MICROTCP_RCVBUF_IDLE_US;
+}
+
+/* A connection that received nothing for a while gives its grown ring
+   back. The window update reaches the peer before it sends again.
+   Returns 0 on success, -1 if the update could not be sent */
+static int recvbuf_idle (microtcp_sock_t *socket)
+{
+  uint64_t deadline = recvbuf_idle_deadline(socket);
+
+  if(deadline == 0 || now_us() < deadline)
+    return 0;
+  if(recvbuf_resize(socket, MICROTCP_RECVBUF_LEN) < 0)
+    return 0;
+  socket->rcvq_stamp_us = 0;
+  socket->rcv_rtt_stamp_us = 0;
+  return send_ack(socket);
+}
+
+/* Runs the connection until one event: sends what the windows allow,
+   then handles the first segment to arrive or timer to expire. The wait
+   also ends at deadline, unless it is 0. Returns 0 on success, -1 if the
+   connection broke */
+static int run_connection (microtcp_sock_t *socket, uint64_t deadline)
+{
+  uint8_t segbuf[MICROTCP_MAX_SEGMENT];
+  uint64_t now, timer;
+  ssize_t ret;
+
+  if(fill_window(socket) < 0)
+    return -1;
+
+  now = now_us();
+  timer = next_timer(socket);
+  if(deadline != 0 && (timer == 0 || deadline < timer))
+    timer = deadline;
+  ret = recv_segment(socket, segbuf, sizeof(segbuf),
+                     timer == 0 ? -1 : timer > now ? (int64_t)(timer - now) : 0);
+  if(ret < 0)
+    return -1;
+  if(ret == 0)
+    return on_timer(socket);
+  return process_segment(socket, segbuf, ret);
+}
+
+int
+microtcp_shutdown (microtcp_sock_t *socket, int how)
+{
+  microtcp_header_t finack, ack;
+  ssize_t ret;
+  uint8_t segbuf[MICROTCP_MAX_SEGMENT];
+  uint64_t now, deadline;
+  int peer_fin = 0;
+
+  /* A connection already given up has no peer to exchange FINs with */
+  if(socket->state == INVALID){
+    free_recvbuf(socket);
+    free_rtx_queue(socket);
+    errno = ENOTCONN;
+    return -1;
+  }
+
+  if(how == SHUT_RDWR){
+
+    /* The FIN follows the data still in the send buffer, which leaves
+       without waiting for more */
+    socket->cork = 0;
+    socket->nodelay = 1;
+    while(socket->rtx_head){
+      if(run_connection(socket, 0) < 0){
+        free_rtx_queue(socket);
+        socket->state = INVALID;
+        return -1;
+      }
+    }
+
+    //SEND FINACK, RECEIVE ACK
+    /* create FIN ACK segment. The FIN consumes one sequence number */
+    finack = make_header(socket->seq_number, socket->ack_number, advertised_window(socket), 0, 1, 0, 0, 1);
+    socket->seq_number += 1;
+
+    /* send it until the peer acknowledges it. Late segments of the connection are skipped */
+    ret = control_exchange(socket, &finack, segbuf, sizeof(segbuf), is_ack_of_all);
+    if(ret <= 0)
+    {
+      socket->state = INVALID;
+      return -1;
+    }
+    ack = get_hbo_header((microtcp_header_t *)segbuf);
+
+    /* the peer may have acknowledged our FIN together with its own */
+    if(socket->state != CLOSING_BY_PEER && is_header_control_valid(&ack, 0, 0, 0, 1)){
+      finack = ack;
+      peer_fin = 1;
+    }
+
+    //RECEIVE FINACK, SEND ACK
+    if(socket->state != CLOSING_BY_PEER){
+
+      socket->state = CLOSING_BY_HOST;
+      
+      /* wait to receive FIN ACK, for at most MICROTCP_FIN_TIMEOUT_US */
+      deadline = now_us() + MICROTCP_FIN_TIMEOUT_US;
+      while(!peer_fin)
+      {
+        now = now_us();
+        ret = now < deadline ? recv_segment(socket, segbuf, sizeof(segbuf), deadline - now) : 0;
+        if(ret <= 0)
+        {
+          socket->state = INVALID;
+          return socket->sd;
+        }
+        finack = get_hbo_header((microtcp_header_t*)segbuf);
+        peer_fin = is_header_control_valid(&finack, 1, 0, 0, 1);
+      }
+
+      socket->ack_number = finack.seq_number + 1;
+
+      /* create the ACK of the FIN of the peer */
+      ack = make_header(socket->seq_number, socket->ack_number, advertised_window(socket), 0, 1, 0, 0, 0);
+
+      /* send ACK to the peer. A short TIME-WAIT follows: for two RTOs a
+         FIN the peer resends, because the ACK was lost, is acknowledged
+         again */
+      deadline = now_us() + 2 * socket->rto_us;
+      do
+      {
+        if(send_segment(socket, &ack, NULL, 0, NULL, 0) < 0){
+          socket->state = INVALID;
+          return socket->sd;
+        }
+        do
+        {
+          now = now_us();
+          ret = now < deadline ? recv_segment(socket, segbuf, sizeof(segbuf), deadline - now) : 0;
+          finack = get_hbo_header((microtcp_header_t*)segbuf);
+        } while(ret > 0 && !is_header_control_valid(&finack, 0, 0, 0, 1));
+      } while(ret > 0);
+    }
+    
+    socket->state = CLOSED;
+    free_recvbuf(socket);
+    free_rtx_queue(socket);
+    microtcp_cc_detach(socket);
+    return socket->sd;
+  }
+  return socket->sd;
+}
+
+ssize_t
+microtcp_send (microtcp_sock_t *socket, const void *buffer, size_t length,
+               int flags)
+{
+  size_t queued = 0;
+  uint64_t paced;
+  ssize_t ret;
+
+  if(socket->state != ESTABLISHED && socket->state != CLOSING_BY_PEER)
+    return -1;
+
+  /* Wait for ACKs to make room until the whole buffer is queued */
+  for(;;){
+    ret = sndbuf_append(socket, (const uint8_t *)buffer + queued, length - queued);
+    if(ret >= 0)
+      queued += ret;
+    if(ret < 0 || (queued < length && run_connection(socket, 0) < 0)){
+      free_rtx_queue(socket);
+      socket->state = INVALID;
+      return -1;
+    }
+    if(queued == length)
+      break;
+  }
+
+  /* Past the low watermark, half the send buffer, wait for ACKs: what
+     is left goes out on later calls, or microtcp_flush() */
+  while(sndbuf_used(socket) > sndbuf_limit(socket) / 2){
+    if(run_connection(socket, 0) < 0){
+      free_rtx_queue(socket);
+      socket->state = INVALID;
+      return -1;
+    }
+  }
+
+  /* Send what the windows allow now. Pacing only spaces the segments
+     out: wait for it rather than leave them to the next call */
+  do{
+    if(fill_window(socket) < 0){
+      free_rtx_queue(socket);
+      socket->state = INVALID;
+      return -1;
+    }
+    paced = socket->pacing_timer_us;
+    if(paced && run_connection(socket, paced) < 0){
+      free_rtx_queue(socket);
+      socket->state = INVALID;
+      return -1;
+    }
+  }while(paced);
+  return queued;
+}
+
+ssize_t
+microtcp_flush (microtcp_sock_t *socket, uint64_t timeout_us)
+{
+  uint64_t deadline = now_us() + timeout_us;
+
+  if(socket->state != ESTABLISHED && socket->state != CLOSING_BY_PEER)
+    return -1;
+
+  /* With nothing to wait for, only what already arrived or expired is handled */
+  do{
+    if(run_connection(socket, socket->rtx_head ? deadline : now_us()) < 0){
+      free_rtx_queue(socket);
+      socket->state = INVALID;
+      return -1;
+    }
+  }while(socket->rtx_head && now_us() < deadline);
+  return sndbuf_used(socket);
+}
+
+ssize_t
+microtcp_recv (microtcp_sock_t *socket, void *buffer, size_t length, int flags)
+{
+  size_t len;
+
+  /* Block until some in-order data is available */
+  while(socket->recvbuf_tail == socket->recvbuf_head){
+    if(socket->state == CLOSING_BY_PEER)
+      return 0;
+    if(socket->state != ESTABLISHED)
+      return -1;
+
+    /* Queued data keeps going out meanwhile. Wake up to shrink the
+       ring if nothing arrives for long */
+    if(run_connection(socket, recvbuf_idle_deadline(socket)) < 0
+       || recvbuf_idle(socket) < 0){
+      socket->state = INVALID;
+      return -1;
+    }
+  }
+
+  len = recvbuf_read(socket, buffer, length);
+  recvbuf_autotune(socket);
+  /* A delayed ACK that fell due while data was waiting leaves now. So
+     does a window update once the window at least doubles, before the
+     peer, maybe stuck on a closed window, has to probe */
+  if(((socket->delack_timer_us && now_us() >= socket->delack_timer_us)
+      || (window_may_open(socket) && recvbuf_free(socket) >= 2 * window_promised(socket)))
+     && send_ack(socket) < 0){
+    socket->state = INVALID;
+    return -1;
+  }
+  return len;
+}
+
+int
+microtcp_setsockopt (microtcp_sock_t *socket, int option, const void *value,
+                     size_t len)
+{
+  const microtcp_cc_ops_t *ops;
+  char name[MICROTCP_CC_NAME_MAX + 1];
+  size_t size = 0;
+  uint64_t us = 0;
+  int flag = 0;
+
+  if(!value){
+    errno = EINVAL;
+    return -1;
+  }
+
+  switch(option){
+  case MICROTCP_SO_RCVBUF:
+  case MICROTCP_SO_SNDBUF:
+  case MICROTCP_SO_MSS:
+  case MICROTCP_SO_INIT_CWND:
+  case MICROTCP_SO_ACK_FREQ:
+    if(len != sizeof(size)){
+      errno = EINVAL;
+      return -1;
+    }
+    memcpy(&size, value, sizeof(size));
+    break;
+  case MICROTCP_SO_NODELAY:
+  case MICROTCP_SO_CORK:
+    if(len != sizeof(flag)){
+      errno = EINVAL;
+      return -1;
+    }
+    memcpy(&flag, value, sizeof(flag));
+    break;
+  case MICROTCP_SO_RTO_INIT:
+  case MICROTCP_SO_RTO_MIN:
+  case MICROTCP_SO_RTO_MAX:
+  case MICROTCP_SO_ACK_DELAY:
+    if(len != sizeof(us)){
+      errno = EINVAL;
+      return -1;
+    }
+    memcpy(&us, value, sizeof(us));
+    break;
+  case MICROTCP_SO_CONGESTION:
+    if(len == 0 || len > MICROTCP_CC_NAME_MAX){
+      errno = EINVAL;
+      return -1;
+    }
+    memcpy(name, value, len);
+    name[len] = '\0';
+    break;
+  default:
+    errno = ENOPROTOOPT;
+    return -1;
+  }
+
+  switch(option){
+  case MICROTCP_SO_RCVBUF:
+    /* A fixed size replaces auto-tuning, so it has to be chosen before
+       the handshake sizes the window scale */
+    if(socket->recvbuf){
+      errno = EISCONN;
+      return -1;
+    }
+    if(size < MICROTCP_MIN_RECVBUF_LEN || size > MICROTCP_MAX_RECVBUF_LEN){
+      errno = EINVAL;
+      return -1;
+    }
+    socket->recvbuf_len = round_pow2(size);
+    socket->rcvbuf_auto = 0;
+    socket->init_win_size = socket->recvbuf_len;
+    socket->curr_win_size = socket->recvbuf_len;
+    break;
+  case MICROTCP_SO_SNDBUF:
+    if(size < MICROTCP_MIN_SNDBUF_LEN){
+      errno = EINVAL;
+      return -1;
+    }
+    socket->sndbuf_len = size;
+    socket->sndbuf_auto = 0;
+    return 0;
+  case MICROTCP_SO_MSS:
+    if(size < MICROTCP_MIN_MSS || size > MICROTCP_MAX_MSS){
+      errno = EINVAL;
+      return -1;
+    }
+    socket->mss = size;
+    break;
+  case MICROTCP_SO_NODELAY:
+  case MICROTCP_SO_CORK:
+    if(option == MICROTCP_SO_NODELAY)
+      socket->nodelay = flag != 0;
+    else
+      socket->cork = flag != 0;
+    /* What was held back leaves now, as with TCP_NODELAY and TCP_CORK */
+    if(socket->state == ESTABLISHED && socket->unsent_head && fill_window(socket) < 0){
+      free_rtx_queue(socket);
+      socket->state = INVALID;
+      errno = EIO;
+      return -1;
+    }
+    return 0;
+  case MICROTCP_SO_INIT_CWND:
+    if(size == 0){
+      errno = EINVAL;
+      return -1;
+    }
+    socket->init_cwnd = size;
+    break;
+  case MICROTCP_SO_CONGESTION:
+    ops = microtcp_cc_find(name);
+    if(!ops){
+      errno = ENOENT;
+      return -1;
+    }
+    microtcp_cc_attach(socket, ops);
+    return 0;
+  /* The RTO bounds always keep min <= init <= max <= MICROTCP_RTO_LIMIT_US,
+     so each check only looks at its neighbours */
+  case MICROTCP_SO_RTO_INIT:
+    if(us < socket->rto_min_us || us > socket->rto_max_us){
+      errno = EINVAL;
+      return -1;
+    }
+    socket->rto_init_us = us;
+    if(socket->srtt_us == 0)
+      socket->rto_us = us;
+    break;
+  case MICROTCP_SO_RTO_MIN:
+    if(us == 0 || us > socket->rto_init_us){
+      errno = EINVAL;
+      return -1;
+    }
+    socket->rto_min_us = us;
+    break;
+  case MICROTCP_SO_RTO_MAX:
+    if(us < socket->rto_init_us || us > MICROTCP_RTO_LIMIT_US){
+      errno = EINVAL;
+      return -1;
+    }
+    socket->rto_max_us = us;
+    break;
+  case MICROTCP_SO_ACK_FREQ:
+  case MICROTCP_SO_ACK_DELAY:
+    /* The peer learns both at the handshake */
+    if(socket->recvbuf){
+      errno = EISCONN;
+      return -1;
+    }
+    if(option == MICROTCP_SO_ACK_FREQ){
+      if(size == 0 || size > MICROTCP_MAX_ACK_FREQ){
+        errno = EINVAL;
+        return -1;
+      }
+      socket->ack_freq = size;
+    }
+    else{
+      if(us == 0 || us > MICROTCP_MAX_ACK_DELAY_US){
+        errno = EINVAL;
+        return -1;
+      }
+      socket->ack_delay_us = us;
+    }
+    return 0;
+  }
+
+  /* Nothing was sent yet: restart the congestion control from the new
+     initial window and ssthresh */
+  if(!socket->recvbuf && option != MICROTCP_SO_RTO_INIT
+     && option != MICROTCP_SO_RTO_MIN && option != MICROTCP_SO_RTO_MAX)
+    microtcp_cc_attach(socket, socket->cc);
+  return 0;
+}
+
+int
+microtcp_getsockopt (microtcp_sock_t *socket, int option, void *value,
+                     size_t *len)
+{
+  const void *src;
+  size_t src_len;
+  size_t size;
+  uint64_t us;
+  int flag;
+
+  src = &size;
+  src_len = sizeof(size);
+  switch(option){
+  case MICROTCP_SO_RCVBUF:
+    size = socket->recvbuf_len;
+    break;
+  case MICROTCP_SO_SNDBUF:
+    size = sndbuf_limit(socket);
+    break;
+  case MICROTCP_SO_MSS:
+    size = socket->mss;
+    break;
+  case MICROTCP_SO_NODELAY:
+  case MICROTCP_SO_CORK:
+    flag = option == MICROTCP_SO_NODELAY ? socket->nodelay : socket->cork;
+    src = &flag;
+    src_len = sizeof(flag);
+    break;
+  case MICROTCP_SO_INIT_CWND:
+    size = socket->init_cwnd;
+    break;
+  case MICROTCP_SO_ACK_FREQ:
+    size = socket->ack_freq;
+    break;
+  case MICROTCP_SO_CONGESTION:
+    src = socket->cc->name;
+    src_len = strnlen(socket->cc->name, MICROTCP_CC_NAME_MAX);
+    break;
+  case MICROTCP_SO_RTO_INIT:
+  case MICROTCP_SO_RTO_MIN:
+  case MICROTCP_SO_RTO_MAX:
+    us = option == MICROTCP_SO_RTO_INIT ? socket->rto_init_us
+         : option == MICROTCP_SO_RTO_MIN ? socket->rto_min_us : socket->rto_max_us;
+    src = &us;
+    src_len = sizeof(us);
+    break;
+  case MICROTCP_SO_ACK_DELAY:
+    us = socket->ack_delay_us;
+    src = &us;
+    src_len = sizeof(us);
+    break;
+  default:
+    errno = ENOPROTOOPT;
+    return -1;
+  }
+
+  if(!value || !len || *len < src_len){
+    errno = EINVAL;
+    return -1;
+  }
+  memcpy(value, src, src_len);
+  /* Strings are terminated when there is room */
+  if(option == MICROTCP_SO_CONGESTION && *len > src_len)
+    ((char *)value)[src_len] = '\0';
+  *len = src_len;
+  return 0;
 }
@@ -26,14 +26,113 @@
 #include <stdint.h>
 
 /*
- * Several useful constants
+ * Several useful constants. Those marked as defaults can be changed per
+ * socket with microtcp_setsockopt()
  */
-#define MICROTCP_ACK_TIMEOUT_US 200000
-#define MICROTCP_MSS 1400
-#define MICROTCP_RECVBUF_LEN 8192
+#define MICROTCP_ACK_TIMEOUT_US 200000        /* Default initial RTO, before any RTT sample */
+#define MICROTCP_MIN_RTO_US 1000              /* Default */
+#define MICROTCP_MAX_RTO_US 60000000          /* Default */
+#define MICROTCP_RTO_LIMIT_US 120000000       /* Largest RTO the options accept */
+#define MICROTCP_CLOCK_GRANULARITY_US 100
+#define MICROTCP_MSS 1400                     /* Default */
+#define MICROTCP_MIN_MSS 128
+#define MICROTCP_MAX_MSS 8900                 /* Fits a 9000-byte jumbo frame with all headers */
+#define MICROTCP_RECVBUF_LEN 8192             /* Default */
+#define MICROTCP_MIN_RECVBUF_LEN 1024
+#define MICROTCP_MAX_RECVBUF_LEN (1u << 30)   /* The largest window MICROTCP_MAX_WSCALE advertises */
+/* Receive buffer auto-tuning: the largest ring one connection grows to,
+   the memory all the rings of the process may take, and how long a
+   connection receives nothing before its ring shrinks back */
+#define MICROTCP_RCVBUF_AUTO_MAX (8u << 20)
+#define MICROTCP_RCVBUF_MEM_MAX (256u << 20)
+#define MICROTCP_RCVBUF_IDLE_US 5000000
+/* Send buffer: data queued and not yet acknowledged. Unless set with
+   MICROTCP_SO_SNDBUF it holds twice the congestion window, within these
+   bounds per connection and MICROTCP_SNDBUF_MEM_MAX for the process */
+#define MICROTCP_SNDBUF_LEN 65536             /* Default */
+#define MICROTCP_MIN_SNDBUF_LEN 1024
+#define MICROTCP_SNDBUF_AUTO_MAX (8u << 20)
+#define MICROTCP_SNDBUF_MEM_MAX (256u << 20)
+#define MICROTCP_CORK_TIMEOUT_US 200000       /* Longest a corked partial segment waits */
+#define MICROTCP_NAGLE_TIMEOUT_US 10000       /* Longest Nagle's algorithm holds a partial segment */
 #define MICROTCP_WIN_SIZE MICROTCP_RECVBUF_LEN
-#define MICROTCP_INIT_CWND (3 * MICROTCP_MSS)
+#define MICROTCP_INIT_CWND_SEGS 3             /* Default, in segments */
+#define MICROTCP_INIT_CWND (MICROTCP_INIT_CWND_SEGS * MICROTCP_MSS)
 #define MICROTCP_INIT_SSTHRESH MICROTCP_WIN_SIZE
+/* Delayed ACKs: data segments one ACK covers at most and how long an ACK
+   waits for them. The largest values the SYN option can carry */
+#define MICROTCP_ACK_FREQ 2                   /* Default */
+#define MICROTCP_ACK_DELAY_US 25000           /* Default */
+#define MICROTCP_MAX_ACK_FREQ 15
+#define MICROTCP_MAX_ACK_DELAY_US 255000
+#define MICROTCP_DUPACK_THRESH 3
+/* A SYN, SYN-ACK or FIN is resent this many times, with the RTO doubled
+   every time, before the connection is given up. microtcp_shutdown()
+   waits this long for the FIN of the peer, like Linux tcp_fin_timeout */
+#define MICROTCP_CONTROL_RETRIES 6
+#define MICROTCP_FIN_TIMEOUT_US 60000000
+/* Retransmission timeouts in a row without an ACK of new data, or window
+   probes in a row without an answer, before the peer is taken for dead,
+   like Linux tcp_retries2 */
+#define MICROTCP_DATA_RETRIES 15
+/* Pacing rate, in percent of cwnd / SRTT, when the congestion control
+   does not provide one */
+#define MICROTCP_PACING_SS_GAIN 200
+#define MICROTCP_PACING_CA_GAIN 120
+#define MICROTCP_CC_PRIV_WORDS 16
+#define MICROTCP_CC_NAME_MAX 16
+#define MICROTCP_DEFAULT_CC "reno"
+#define MICROTCP_MAX_OOO_RANGES 32
+#define MICROTCP_MAX_SACK_BLOCKS 4
+#define MICROTCP_MAX_WSCALE 14
+
+/*
+ * The future_use0 field of the header is the option word. On SYN segments
+ * it lists the extensions the host supports. On every other segment it
+ * describes the option blocks that follow the header, before the payload.
+ *
+ * A SACK block is a pair of 32-bit sequence numbers [start, end) in network
+ * byte order, reporting data the receiver holds past the cumulative ACK.
+ * The first block is a duplicate SACK (DSACK, RFC 2883) instead when it
+ * lies below the cumulative ACK or inside the second block: it reports
+ * data that arrived twice.
+ *
+ * When timestamps are agreed on, every segment carries the sender's clock
+ * in microseconds (TSval) in future_use1, and echoes the TSval of the last
+ * in-order segment it received (TSecr) in future_use2.
+ *
+ * MICROTCP_OPT_ECN on a SYN means the host reports the ECN congestion
+ * experienced (CE) marks it receives: each ACK carries the ECE flag if the
+ * last data segment it acknowledges arrived marked.
+ *
+ * MICROTCP_OPT_WSCALE on a SYN carries the shift the host applies to the
+ * windows it advertises, in bits 8 to 11 (RFC 7323). Windows are scaled
+ * only once both hosts sent it, and never on SYN segments themselves.
+ *
+ * MICROTCP_OPT_DELACK on a SYN means the host delays its ACKs. Bits 12 to
+ * 15 carry the most data segments it covers with one ACK and bits 16 to 23
+ * the longest it delays one, in milliseconds. Both hosts use the lower of
+ * the two segment counts, and each adds the delay of its peer to its RTO
+ * and tail loss probe. ACKs are delayed only once both hosts sent it.
+ * Out-of-order and duplicate data are acknowledged at once, and so are
+ * data segments flagged PSH_F, the last of the sender's buffer, unless a
+ * reply usually follows them. Data segments acknowledge like pure ACKs,
+ * SACK blocks and CE echo included.
+ */
+#define MICROTCP_OPT_SACK_PERMITTED 0x80000000u
+#define MICROTCP_OPT_TIMESTAMPS 0x40000000u
+#define MICROTCP_OPT_ECN 0x20000000u
+#define MICROTCP_OPT_WSCALE 0x10000000u
+#define MICROTCP_OPT_DELACK 0x08000000u
+#define MICROTCP_OPT_WSCALE_SHIFT(w) (((w) >> 8) & 0x0f)
+#define MICROTCP_OPT_ACK_FREQ(w) (((w) >> 12) & 0x0f)
+#define MICROTCP_OPT_ACK_DELAY_MS(w) (((w) >> 16) & 0xff)
+#define MICROTCP_OPT_SACK_COUNT(w) ((w) & 0xff)
+
+/* The receive buffer is a ring indexed with a mask */
+#if (MICROTCP_RECVBUF_LEN & (MICROTCP_RECVBUF_LEN - 1)) != 0
+#error "MICROTCP_RECVBUF_LEN must be a power of two"
+#endif
 
 /**
  * Possible states of the microTCP socket
@@ -54,35 +153,226 @@ typedef enum
 
 typedef enum
 {
+  PSH_F = 10,
+  ECE_F = 11,
   ACK_F = 12,
   RST_F = 13,
   SYN_F = 14,
   FIN_F = 15
 } microtcp_flag_bits_t;
 
+/**
+ * A range [start, end) of sequence numbers
+ */
+typedef struct
+{
+  uint32_t start;
+  uint32_t end;
+} microtcp_range_t;
+
+/**
+ * A segment of the retransmission queue. Segments are kept in sequence
+ * order and are released as soon as the peer acknowledges them cumulatively.
+ */
+typedef struct microtcp_segment
+{
+  uint32_t seq_number;          /**< Sequence number of the first payload byte */
+  uint32_t data_len;            /**< Payload length in bytes */
+  uint32_t data_cap;            /**< Room for the payload. Writes fill a segment never sent up to it */
+  uint8_t *data;                /**< The payload, a copy owned by the segment */
+  uint64_t sent_us;             /**< Time of the last (re)transmission in microseconds, 0 if never sent */
+  uint32_t retransmissions;     /**< How many times the segment has been retransmitted */
+  uint8_t lost;                 /**< Set if the segment must be retransmitted */
+  uint8_t sacked;               /**< Set if the peer reported it with a SACK block */
+  uint8_t tx_app_limited;       /**< The sender was application limited when it was sent */
+  uint64_t tx_delivered;        /**< socket->delivered when it was sent */
+  uint64_t tx_delivered_us;     /**< socket->delivered_us when it was sent */
+  uint64_t tx_first_sent_us;    /**< socket->first_sent_us when it was sent */
+  struct microtcp_segment *next;
+} microtcp_segment_t;
+
+struct microtcp_sock;
+
+/**
+ * What an ACK that acknowledged new data tells the congestion control
+ */
+typedef struct
+{
+  uint32_t acked;               /**< Bytes newly acknowledged cumulatively */
+  uint64_t rtt_us;              /**< RTT sample carried by the ACK, 0 if none */
+  uint64_t now_us;              /**< When the ACK was processed */
+  size_t prior_in_flight;       /**< Bytes in flight before the ACK arrived */
+  uint8_t in_recovery;          /**< The sender is recovering from a loss */
+  uint8_t ece;                  /**< The ACK echoed a congestion experienced mark */
+  uint8_t owd_valid;            /**< owd_us holds a sample */
+  uint32_t owd_us;              /**< One-way delay to the peer plus the offset between the two
+                                     clocks, from the timestamps. Only its variations matter */
+
+  /* Delivery rate sample: delivered bytes over interval_us. It is taken
+     from the most recently sent segment the ACK acknowledged or SACKed */
+  uint64_t prior_delivered;     /**< socket->delivered when that segment was sent */
+  uint64_t delivered;           /**< Bytes delivered since then, 0 if there is no sample */
+  uint64_t interval_us;         /**< Longest of its send and ACK intervals */
+  uint8_t is_app_limited;       /**< The rate was limited by the application, not the network */
+} microtcp_ack_sample_t;
+
+/* The algorithm reacts to ECN marks: data segments are sent ECN capable */
+#define MICROTCP_CC_FLAG_ECN 0x1
+
+/**
+ * A congestion control algorithm. The callbacks drive the cwnd and ssthresh
+ * fields of the socket and may keep their own state in cc_priv. Every
+ * callback but on_ack may be NULL.
+ */
+typedef struct microtcp_cc_ops
+{
+  const char *name;
+  unsigned int flags;           /**< MICROTCP_CC_FLAG_* */
+  /** Sets up the initial window, when the algorithm is attached to a socket */
+  void (*init) (struct microtcp_sock *socket);
+  /** New data was acknowledged */
+  void (*on_ack) (struct microtcp_sock *socket, const microtcp_ack_sample_t *sample);
+  /** Fast retransmit: set ssthresh, the window recovery will converge to */
+  void (*on_loss) (struct microtcp_sock *socket);
+  /** The retransmission timer expired: set both ssthresh and cwnd */
+  void (*on_rto) (struct microtcp_sock *socket);
+  /** The last reduction was spurious: cwnd and ssthresh are already restored */
+  void (*undo) (struct microtcp_sock *socket);
+  /** Preferred sending rate in bytes per second, 0 for none */
+  uint64_t (*pacing_rate) (const struct microtcp_sock *socket);
+  /** The algorithm is detached from the socket */
+  void (*release) (struct microtcp_sock *socket);
+} microtcp_cc_ops_t;
+
 /**
  * This is the microTCP socket structure. It holds all the necessary
  * information of each microTCP socket.
  *
  * NOTE: Fill free to insert additional fields.
  */
-typedef struct
+typedef struct microtcp_sock
 {
   int sd;                       /**< The underline UDP socket descriptor */
   mircotcp_state_t state;       /**< The state of the microTCP socket */
   size_t init_win_size;         /**< The window size negotiated at the 3-way handshake */
   size_t curr_win_size;         /**< The current window size */
 
+  size_t mss;                   /**< Largest payload of a segment, see MICROTCP_SO_MSS */
+  size_t init_cwnd;             /**< Initial congestion window in segments, see MICROTCP_SO_INIT_CWND */
+  uint64_t rto_init_us;         /**< RTO until the first RTT sample, see MICROTCP_SO_RTO_INIT */
+  uint64_t rto_min_us;          /**< Lower bound of the RTO, see MICROTCP_SO_RTO_MIN */
+  uint64_t rto_max_us;          /**< Upper bound of the RTO with backoff, see MICROTCP_SO_RTO_MAX */
+
   uint8_t *recvbuf;             /**< The *receive* buffer of the TCP
                                      connection. It is allocated during the connection establishment and
-                                     is freed at the shutdown of the connection. This buffer is used
-                                     to retrieve the data from the network. */
-  size_t buf_fill_level;        /**< Amount of data in the buffer */
+                                     is freed at the shutdown of the connection. It is a circular
+                                     buffer holding the in-order data not yet read by the application. */
+  size_t recvbuf_len;           /**< Capacity of the receive buffer, always a power of two */
+  uint8_t rcvbuf_auto;          /**< The receive buffer follows the rate the application reads at.
+                                     Setting MICROTCP_SO_RCVBUF turns it off */
+  size_t recvbuf_head;          /**< Stream offset of the next byte the application will read */
+  size_t recvbuf_tail;          /**< Stream offset right after the last in-order byte received.
+                                     Both offsets only grow; they are masked to index the buffer */
+  microtcp_range_t ooo_ranges[MICROTCP_MAX_OOO_RANGES]; /**< Out-of-order data already stored in the
+                                     receive buffer past recvbuf_tail, sorted by sequence number */
+  size_t ooo_count;             /**< Number of valid entries in ooo_ranges */
+  size_t ooo_last;              /**< Index of the range that grew most recently */
+  uint8_t sack_permitted;       /**< Both ends agreed on SACK during the handshake */
+  uint8_t ts_enabled;           /**< Both ends agreed on timestamps during the handshake */
+  uint32_t ts_recent;           /**< TSval to echo back to the peer */
+  uint8_t ecn_permitted;        /**< The socket reads the ECN codepoint and, once connected,
+                                     the peer echoes CE marks, see MICROTCP_OPT_ECN */
+  uint8_t snd_wscale;           /**< Shift of the windows the peer advertises, see MICROTCP_OPT_WSCALE */
+  uint8_t rcv_wscale;           /**< Shift of the windows advertised to the peer */
+  uint8_t rx_ce;                /**< The last datagram received was CE marked */
+  uint8_t ce_echo;              /**< The last data segment received was CE marked */
+  uint64_t rcv_rtt_us;          /**< RTT estimated by the receiver, 0 until the first sample */
+  uint32_t rcv_rtt_seq;         /**< Without timestamps, the sequence number ending the window being timed */
+  uint64_t rcv_rtt_stamp_us;    /**< When the window being timed started, 0 if none is */
+  size_t rcvq_head;             /**< recvbuf_head when the current auto-tuning round started */
+  uint64_t rcvq_stamp_us;       /**< When the current auto-tuning round started, 0 if none did */
+  uint64_t rcv_last_us;         /**< When data last arrived */
+  uint8_t dsack_pending;        /**< The next ACK reports [dsack_start, dsack_end) as received twice */
+  uint32_t dsack_start;
+  uint32_t dsack_end;
+  uint8_t ack_freq;             /**< Data segments one ACK covers at most, see MICROTCP_OPT_DELACK */
+  uint64_t ack_delay_us;        /**< Longest an ACK waits for more data, see MICROTCP_SO_ACK_DELAY */
+  uint64_t peer_ack_delay_us;   /**< Longest the peer delays its ACKs, 0 if it does not */
+  uint8_t ack_pending;          /**< Data segments received and not acknowledged yet */
+  uint64_t delack_timer_us;     /**< When the pending ACK is sent anyway, 0 if none is pending */
+  uint32_t last_ack_sent;       /**< Cumulative ACK of the last segment sent */
+  uint8_t pingpong;             /**< Replies carry the ACKs of the requests, so pushed data
+                                     waits for one like any other data */
+  uint32_t rcv_wnd_edge;        /**< Right edge of the last window advertised */
 
   size_t cwnd;
   size_t ssthresh;
+  const microtcp_cc_ops_t *cc;  /**< Congestion control algorithm of the socket */
+  uint64_t cc_priv[MICROTCP_CC_PRIV_WORDS]; /**< Private state of the algorithm */
 
   size_t seq_number;            /**< Keep the state of the sequence number */
+  size_t snd_una;               /**< Oldest sequence number not yet acknowledged by the peer */
+  size_t write_seq;             /**< Sequence number after the last byte queued by microtcp_send() */
+  size_t bytes_in_flight;       /**< Bytes sent but neither acknowledged, SACKed nor considered lost */
+  microtcp_segment_t *rtx_head; /**< Oldest unacknowledged segment */
+  microtcp_segment_t *unsent_head; /**< First segment of the queue never sent, NULL if all were */
+  size_t sndbuf_len;            /**< Bytes the send buffer holds, see MICROTCP_SO_SNDBUF */
+  uint8_t sndbuf_auto;          /**< The send buffer follows the congestion window */
+  uint8_t nodelay;              /**< Nagle's algorithm is off, see MICROTCP_SO_NODELAY */
+  uint8_t cork;                 /**< Partial segments are held, see MICROTCP_SO_CORK */
+  uint64_t cork_timer_us;       /**< When a corked partial segment leaves anyway, 0 if none waits */
+  uint64_t nagle_timer_us;      /**< When the segment Nagle's algorithm holds leaves anyway, 0 if none */
+  size_t max_peer_win;          /**< Largest window the peer advertised */
+  uint64_t persist_timer_us;    /**< When the next window probe is sent, 0 if the window is open */
+  uint8_t persist_backoff;      /**< Doublings of the probe interval since the peer's window closed */
+  size_t persist_probes;        /**< Window probes sent since the peer last answered */
+  microtcp_segment_t *rtx_tail; /**< Most recently queued segment */
+  uint32_t dup_acks;            /**< Consecutive duplicate ACKs received */
+  uint8_t in_recovery;          /**< Set during fast recovery */
+  size_t recover;               /**< Recovery ends when this sequence number is acknowledged */
+  uint64_t recovery_start_us;   /**< When the current fast recovery started */
+  size_t recover_fs;            /**< Flight size when recovery started */
+  size_t prr_delivered;         /**< Bytes the peer received since recovery started */
+  size_t prr_out;               /**< Bytes sent since recovery started */
+  size_t prr_credited;          /**< Without SACK: bytes counted as delivered for duplicate
+                                     ACKs, not yet cumulatively acknowledged */
+  uint64_t delivered;           /**< Bytes acknowledged or SACKed so far */
+  uint64_t delivered_us;        /**< When delivered last grew */
+  uint64_t first_sent_us;       /**< Send time of the segment that starts the current delivery interval */
+  uint64_t app_limited;         /**< Samples stay application limited until delivered passes this, 0 if not limited */
+
+  uint64_t srtt_us;             /**< Smoothed round trip time, 0 until the first sample */
+  uint64_t rttvar_us;           /**< Round trip time variation */
+  uint64_t rto_us;              /**< Current retransmission timeout, including backoff */
+  uint64_t rtx_timer_us;        /**< When the retransmission timer expires, 0 if not running */
+  size_t rtx_backoff;           /**< Retransmission timeouts since new data was last acked */
+  uint64_t min_rtt_us;          /**< Lowest RTT sample so far, 0 until the first one */
+  uint64_t pacing_next_us;      /**< Earliest time the pacing engine lets the next segment leave */
+  uint64_t pacing_timer_us;     /**< When a segment held back by pacing may leave, 0 if none is */
+
+  uint8_t undo_valid;           /**< The undo_* fields describe the last window reduction */
+  uint8_t undo_rto;             /**< The reduction includes a timeout */
+  uint32_t undo_marker;         /**< snd_una when the reduction happened */
+  size_t undo_cwnd;             /**< cwnd before the reduction */
+  size_t undo_ssthresh;         /**< ssthresh before the reduction */
+  uint32_t undo_retrans;        /**< Retransmissions since the reduction the peer has not DSACKed */
+  uint32_t undo_ts;             /**< TSval of the first retransmission, 0 once checked */
+  uint32_t undo_end_seq;        /**< End of the first retransmitted segment */
+
+  uint64_t rack_xmit_us;        /**< RACK: send time of the most recently sent segment delivered */
+  uint32_t rack_end_seq;        /**< RACK: end of that segment, to order segments sent at once */
+  uint64_t rack_rtt_us;         /**< RACK: RTT measured on that segment */
+  uint32_t rack_fack;           /**< RACK: highest sequence number acknowledged or SACKed */
+  uint8_t rack_reordering_seen; /**< RACK: data never retransmitted was delivered below rack_fack, or a DSACK came */
+  uint32_t rack_reo_wnd_mult;   /**< RACK: reordering window in quarters of the min RTT */
+  uint8_t rack_reo_wnd_persist; /**< RACK: recoveries left before rack_reo_wnd_mult drops back to 1 */
+  uint32_t rack_dsack_round;    /**< RACK: a DSACK grows the window again once snd_una passes this */
+  uint64_t rack_timer_us;       /**< When a segment inside the reordering window turns lost, 0 if none */
+  uint64_t tlp_timer_us;        /**< When the tail loss probe is sent, 0 if not armed */
+  uint32_t tlp_end_seq;         /**< snd_nxt when the probe was sent */
+  uint32_t tlp_ts;              /**< TSval of the probe */
+  uint8_t tlp_active;           /**< A probe was sent and its ACK is awaited */
+  uint8_t tlp_retrans;          /**< The probe retransmitted data instead of sending new data */
   size_t ack_number;            /**< Keep the state of the ack number */
   uint64_t packets_send;        
   uint64_t packets_received;
@@ -138,15 +428,132 @@ int
 microtcp_accept (microtcp_sock_t *socket, struct sockaddr *address,
                  socklen_t address_len);
 
+/**
+ * Sends the data still queued, then exchanges FINs with the peer.
+ *
+ * @return the socket descriptor on success or -1 on failure, with errno
+ * set to ETIMEDOUT if the peer stopped answering and ENOTCONN if the
+ * connection was already given up
+ */
 int
 microtcp_shutdown(microtcp_sock_t *socket, int how);
 
+/**
+ * Queues data for transmission. It returns once the data is copied to the
+ * send buffer, at most half the buffer is left unacknowledged and what
+ * the windows allow is sent. There is no thread behind the socket:
+ * the rest is sent, and retransmitted, only while the application calls
+ * into microTCP again. An application with nothing else to send or
+ * receive calls microtcp_flush(). microtcp_shutdown() waits until all of
+ * the data is acknowledged. A partial last segment waits for an ACK or
+ * more data, see MICROTCP_SO_NODELAY.
+ *
+ * @return the number of bytes queued or -1 on failure, with errno set to
+ * ETIMEDOUT if the peer acknowledged nothing for MICROTCP_DATA_RETRIES
+ * retransmission timeouts in a row, or answered none of as many window
+ * probes
+ */
 ssize_t
 microtcp_send (microtcp_sock_t *socket, const void *buffer, size_t length,
                int flags);
 
+/**
+ * Runs the connection until all the data queued by microtcp_send() is
+ * acknowledged, for at most timeout_us: sends what the windows allow,
+ * handles the ACKs and the timers, retransmits. With a timeout of 0 it
+ * only handles what already arrived or expired, without waiting.
+ *
+ * @return the number of bytes still unacknowledged or -1 on failure,
+ * with errno set to ETIMEDOUT as for microtcp_send()
+ */
+ssize_t
+microtcp_flush (microtcp_sock_t *socket, uint64_t timeout_us);
+
 ssize_t
 microtcp_recv (microtcp_sock_t *socket, void *buffer, size_t length, int flags);
 
+/**
+ * The options of microtcp_setsockopt() and microtcp_getsockopt(), with the
+ * type of their value
+ */
+typedef enum
+{
+  MICROTCP_SO_RCVBUF,           /**< size_t, bytes of the receive buffer, rounded up to a
+                                     power of two. Only before the connection is set up.
+                                     Setting it turns receive buffer auto-tuning off */
+  MICROTCP_SO_SNDBUF,           /**< size_t, bytes of the send buffer. Setting it turns
+                                     send buffer auto-tuning off */
+  MICROTCP_SO_MSS,              /**< size_t, largest payload of the segments sent */
+  MICROTCP_SO_NODELAY,          /**< int, non zero turns Nagle's algorithm off: a partial
+                                     segment leaves even with data unacknowledged */
+  MICROTCP_SO_CORK,             /**< int, non zero holds partial segments until the option is
+                                     cleared, for at most MICROTCP_CORK_TIMEOUT_US */
+  MICROTCP_SO_CONGESTION,       /**< string, name of the congestion control algorithm */
+  MICROTCP_SO_INIT_CWND,        /**< size_t, initial congestion window in segments */
+  MICROTCP_SO_RTO_INIT,         /**< uint64_t, RTO in microseconds until the first RTT sample */
+  MICROTCP_SO_RTO_MIN,          /**< uint64_t, lower bound of the RTO in microseconds */
+  MICROTCP_SO_RTO_MAX,          /**< uint64_t, upper bound of the RTO in microseconds, at
+                                     most MICROTCP_RTO_LIMIT_US. The RTO options must keep
+                                     min <= init <= max */
+  MICROTCP_SO_ACK_FREQ,         /**< size_t, data segments one ACK covers at most, up to
+                                     MICROTCP_MAX_ACK_FREQ. 1 turns delayed ACKs off.
+                                     Only before the connection is set up */
+  MICROTCP_SO_ACK_DELAY         /**< uint64_t, longest an ACK is delayed in microseconds, up
+                                     to MICROTCP_MAX_ACK_DELAY_US. Only before the connection
+                                     is set up. The delay is checked by the microTCP calls only */
+} microtcp_sockopt_t;
+
+/**
+ * Sets an option of the socket, like setsockopt(2). Options that size
+ * the connection (MSS, initial window) restart the congestion control
+ * when set before the connection is set up.
+ *
+ * @param socket the socket structure
+ * @param option one of microtcp_sockopt_t
+ * @param value the new value, of the type of the option
+ * @param len the size of the value. For strings, their length
+ * @return 0 on success or -1 with errno set to ENOPROTOOPT for an
+ * unknown option, EINVAL for a bad value or EISCONN for an option that
+ * can no longer change
+ */
+int
+microtcp_setsockopt (microtcp_sock_t *socket, int option, const void *value,
+                     size_t len);
+
+/**
+ * Reads an option of the socket, like getsockopt(2).
+ *
+ * @param socket the socket structure
+ * @param option one of microtcp_sockopt_t
+ * @param value where the value is stored
+ * @param len the room at value on input, the size of the value on output
+ * @return 0 on success or -1 with errno set to ENOPROTOOPT for an
+ * unknown option or EINVAL if the value does not fit
+ */
+int
+microtcp_getsockopt (microtcp_sock_t *socket, int option, void *value,
+                     size_t *len);
+
+/**
+ * Selects the congestion control algorithm of the socket. Call it before
+ * microtcp_connect() or microtcp_accept(); on an established connection
+ * the new algorithm starts from its initial window.
+ *
+ * @param socket the socket structure
+ * @param name the name of a built-in or registered algorithm
+ * @return 0 on success or -1 if there is no such algorithm
+ */
+int
+microtcp_set_congestion_control (microtcp_sock_t *socket, const char *name);
+
+/**
+ * Makes an algorithm selectable by name with microtcp_set_congestion_control().
+ *
+ * @param ops the algorithm. It must stay valid for the lifetime of the program
+ * @return 0 on success or -1 if the name is taken or the registry is full
+ */
+int
+microtcp_register_congestion_control (const microtcp_cc_ops_t *ops);
+
 
 #endif /* LIB_MICROTCP_H_ */
@@ -0,0 +1,135 @@
+/*
+ * microtcp, a lightweight implementation of TCP for teaching,
+ * and academic purposes.
+ *
+ * Copyright (C) 2015-2017  Manolis Surligas <surligas@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "microtcp_cc.h"
+#include <string.h>
+
+#define MICROTCP_CC_MAX_ALGORITHMS 16
+
+/* The built-in algorithms come first, the registered ones follow */
+static const microtcp_cc_ops_t *algorithms[MICROTCP_CC_MAX_ALGORITHMS] = {
+  &microtcp_cc_reno,
+  &microtcp_cc_cubic,
+  &microtcp_cc_bbr,
+  &microtcp_cc_vegas,
+  &microtcp_cc_dctcp,
+  &microtcp_cc_ledbat,
+};
+static size_t nalgorithms = 6;
+
+const microtcp_cc_ops_t *
+microtcp_cc_find (const char *name)
+{
+  size_t i;
+
+  for(i = 0; i < nalgorithms; i++){
+    if(strncmp(algorithms[i]->name, name, MICROTCP_CC_NAME_MAX) == 0)
+      return algorithms[i];
+  }
+  return NULL;
+}
+
+void
+microtcp_cc_detach (microtcp_sock_t *socket)
+{
+  if(socket->cc && socket->cc->release)
+    socket->cc->release(socket);
+  socket->cc = NULL;
+}
+
+void
+microtcp_cc_attach (microtcp_sock_t *socket, const microtcp_cc_ops_t *ops)
+{
+  microtcp_cc_detach(socket);
+  memset(socket->cc_priv, 0, sizeof(socket->cc_priv));
+  socket->cc = ops;
+  socket->cwnd = microtcp_init_cwnd(socket);
+  /* Slow start up to the largest window the peer is expected to offer,
+     which is no more than ours when both auto-tune */
+  socket->ssthresh = socket->rcvbuf_auto && socket->recvbuf_len < MICROTCP_RCVBUF_AUTO_MAX
+                     ? MICROTCP_RCVBUF_AUTO_MAX : socket->recvbuf_len;
+  if(ops->init)
+    ops->init(socket);
+}
+
+size_t
+microtcp_cc_halve (const microtcp_sock_t *socket)
+{
+  size_t ssthresh = microtcp_flight_size(socket) / 2;
+
+  return ssthresh < 2 * socket->mss ? 2 * socket->mss : ssthresh;
+}
+
+int
+microtcp_set_congestion_control (microtcp_sock_t *socket, const char *name)
+{
+  const microtcp_cc_ops_t *ops = microtcp_cc_find(name);
+
+  if(!ops)
+    return -1;
+  microtcp_cc_attach(socket, ops);
+  return 0;
+}
+
+int
+microtcp_register_congestion_control (const microtcp_cc_ops_t *ops)
+{
+  if(!ops || !ops->name || !ops->on_ack || microtcp_cc_find(ops->name)
+     || nalgorithms == MICROTCP_CC_MAX_ALGORITHMS)
+    return -1;
+  algorithms[nalgorithms++] = ops;
+  return 0;
+}
+
+/*
+ * Reno: slow start below ssthresh, one MSS per RTT above it,
+ * half the flight size on loss.
+ */
+
+static void
+reno_on_ack (microtcp_sock_t *socket, const microtcp_ack_sample_t *sample)
+{
+  if(sample->in_recovery)
+    return;
+  if(socket->cwnd < socket->ssthresh)
+    socket->cwnd += microtcp_abc_acked(socket, sample->acked);
+  else
+    socket->cwnd += socket->mss * microtcp_abc_acked(socket, sample->acked) / socket->cwnd + 1;
+}
+
+static void
+reno_on_loss (microtcp_sock_t *socket)
+{
+  socket->ssthresh = microtcp_cc_halve(socket);
+}
+
+static void
+reno_on_rto (microtcp_sock_t *socket)
+{
+  socket->ssthresh = microtcp_cc_halve(socket);
+  socket->cwnd = socket->mss;
+}
+
+const microtcp_cc_ops_t microtcp_cc_reno = {
+  .name = "reno",
+  .on_ack = reno_on_ack,
+  .on_loss = reno_on_loss,
+  .on_rto = reno_on_rto,
+};
@@ -0,0 +1,91 @@
+/*
+ * microtcp, a lightweight implementation of TCP for teaching,
+ * and academic purposes.
+ *
+ * Copyright (C) 2015-2017  Manolis Surligas <surligas@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIB_MICROTCP_CC_H_
+#define LIB_MICROTCP_CC_H_
+
+#include "microtcp.h"
+
+/*
+ * Internal interface between the microTCP core and the congestion control
+ * modules. Applications only see microtcp_set_congestion_control().
+ */
+
+/* Sequence number comparisons that survive the 32-bit wrap around */
+#define SEQ_LT(a, b) ((int32_t)((uint32_t)(a) - (uint32_t)(b)) < 0)
+#define SEQ_LEQ(a, b) ((int32_t)((uint32_t)(a) - (uint32_t)(b)) <= 0)
+#define SEQ_GT(a, b) SEQ_LT(b, a)
+#define SEQ_GEQ(a, b) SEQ_LEQ(b, a)
+
+/* Bytes sent and not yet cumulatively acknowledged (FlightSize of RFC 5681) */
+static inline size_t
+microtcp_flight_size (const microtcp_sock_t *socket)
+{
+  return (uint32_t)(socket->seq_number - socket->snd_una);
+}
+
+/* The congestion window a connection starts with */
+static inline size_t
+microtcp_init_cwnd (const microtcp_sock_t *socket)
+{
+  return socket->init_cwnd * socket->mss;
+}
+
+/* The bytes an ACK counts for when growing the window: those it
+   acknowledged, up to one MSS for every segment the peer may cover with
+   one ACK (appropriate byte counting, RFC 3465) */
+static inline size_t
+microtcp_abc_acked (const microtcp_sock_t *socket, size_t acked)
+{
+  size_t limit = socket->ack_freq * socket->mss;
+
+  return acked < limit ? acked : limit;
+}
+
+/* The private state of the algorithm, which must fit in cc_priv */
+#define MICROTCP_CC_PRIV(socket, type) ((type *)(socket)->cc_priv)
+#define MICROTCP_CC_PRIV_CHECK(type)                                           \
+  typedef char type##_fits_in_cc_priv                                         \
+  [(sizeof(type) <= MICROTCP_CC_PRIV_WORDS * sizeof(uint64_t)) ? 1 : -1]
+
+/* ssthresh after a loss for the loss-based algorithms: half the flight size */
+size_t
+microtcp_cc_halve (const microtcp_sock_t *socket);
+
+/* Returns the algorithm registered under name, or NULL */
+const microtcp_cc_ops_t *
+microtcp_cc_find (const char *name);
+
+/* Attaches an algorithm to the socket, detaching the previous one */
+void
+microtcp_cc_attach (microtcp_sock_t *socket, const microtcp_cc_ops_t *ops);
+
+/* Detaches the algorithm of the socket */
+void
+microtcp_cc_detach (microtcp_sock_t *socket);
+
+extern const microtcp_cc_ops_t microtcp_cc_reno;
+extern const microtcp_cc_ops_t microtcp_cc_cubic;
+extern const microtcp_cc_ops_t microtcp_cc_bbr;
+extern const microtcp_cc_ops_t microtcp_cc_vegas;
+extern const microtcp_cc_ops_t microtcp_cc_dctcp;
+extern const microtcp_cc_ops_t microtcp_cc_ledbat;
+
+#endif /* LIB_MICROTCP_CC_H_ */
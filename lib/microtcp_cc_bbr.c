@@ -0,0 +1,373 @@
+/*
+ * microtcp, a lightweight implementation of TCP for teaching,
+ * and academic purposes.
+ *
+ * Copyright (C) 2015-2017  Manolis Surligas <surligas@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * BBR congestion control: instead of reacting to losses it keeps a model
+ * of the path, the bottleneck bandwidth (the highest delivery rate of the
+ * last rounds) and the propagation delay (the lowest RTT of the last
+ * seconds), and sends at that rate with about one BDP in flight. It moves
+ * through four phases:
+ *
+ *   STARTUP    doubles the rate every round until the bandwidth stops growing
+ *   DRAIN      empties the queue STARTUP built
+ *   PROBE_BW   cruises at the bandwidth, probing for more every few rounds
+ *   PROBE_RTT  drains the pipe briefly when the min RTT has not been
+ *              refreshed for a while, to measure it again
+ */
+
+#include "microtcp_cc.h"
+
+/* Gains are fixed point numbers in units of BBR_UNIT */
+#define BBR_UNIT 256
+#define BBR_HIGH_GAIN (BBR_UNIT * 2885 / 1000 + 1)  /* 2/ln(2) doubles the rate each round */
+#define BBR_DRAIN_GAIN (BBR_UNIT * 1000 / 2885)
+#define BBR_CWND_GAIN (BBR_UNIT * 2)
+
+/* PROBE_BW cycles through these pacing gains, one per min RTT */
+static const uint16_t pacing_gain_cycle[] = {
+  BBR_UNIT * 5 / 4, BBR_UNIT * 3 / 4,
+  BBR_UNIT, BBR_UNIT, BBR_UNIT, BBR_UNIT, BBR_UNIT, BBR_UNIT,
+};
+#define BBR_CYCLE_LEN (sizeof(pacing_gain_cycle) / sizeof(pacing_gain_cycle[0]))
+
+#define BBR_BW_ROUNDS 10                /* Window of the bandwidth filter, in rounds */
+#define BBR_MIN_RTT_WIN_US 10000000     /* Window of the min RTT filter */
+#define BBR_PROBE_RTT_US 200000         /* Time spent in PROBE_RTT */
+#define BBR_MIN_CWND(socket) (4 * (socket)->mss)
+#define BBR_FULL_BW_THRESH (BBR_UNIT * 5 / 4) /* Growth that still counts as growth in STARTUP */
+#define BBR_FULL_BW_ROUNDS 3
+
+typedef enum
+{
+  BBR_STARTUP,
+  BBR_DRAIN,
+  BBR_PROBE_BW,
+  BBR_PROBE_RTT
+} bbr_mode_t;
+
+/* Windowed max of the delivery rate, keeping the best, second best and
+   third best samples of the window (Kathleen Nichols' algorithm) */
+typedef struct
+{
+  uint32_t round;
+  uint64_t bw;
+} bbr_bw_sample_t;
+
+typedef struct
+{
+  bbr_bw_sample_t bw[3];        /**< Bandwidth filter, bytes per second */
+  uint64_t min_rtt_us;          /**< Lowest RTT of the filter window, 0 if none yet */
+  uint64_t min_rtt_stamp;       /**< When min_rtt_us was measured */
+  uint64_t probe_rtt_done_us;   /**< When PROBE_RTT may end, 0 if not yet scheduled */
+  uint64_t cycle_stamp;         /**< When the current PROBE_BW gain phase started */
+  uint64_t next_round_delivered; /**< A round ends when this much data has been delivered */
+  uint64_t full_bw;             /**< Bandwidth STARTUP last saw growing */
+  size_t prior_cwnd;            /**< cwnd before loss recovery or PROBE_RTT */
+  uint32_t round_count;         /**< Round trips so far */
+  uint16_t pacing_gain;
+  uint16_t cwnd_gain;
+  uint8_t mode;                 /**< bbr_mode_t */
+  uint8_t cycle_index;
+  uint8_t full_bw_count;        /**< Rounds without bandwidth growth */
+  uint8_t filled_pipe;          /**< STARTUP found the bandwidth */
+  uint8_t round_start;          /**< The current ACK started a new round */
+  uint8_t probe_rtt_round_done;
+  uint8_t restore_cwnd;         /**< Restore prior_cwnd when loss recovery is over */
+} bbr_t;
+
+MICROTCP_CC_PRIV_CHECK(bbr_t);
+
+static uint64_t
+bbr_max_bw (const bbr_t *bbr)
+{
+  return bbr->bw[0].bw;
+}
+
+static void
+bbr_bw_filter_update (bbr_t *bbr, uint64_t bw)
+{
+  bbr_bw_sample_t s = { bbr->round_count, bw };
+  bbr_bw_sample_t *f = bbr->bw;
+  uint32_t dt;
+
+  /* A new best, or the whole window expired: restart the filter */
+  if(bw >= f[0].bw || s.round - f[2].round > BBR_BW_ROUNDS){
+    f[0] = f[1] = f[2] = s;
+    return;
+  }
+  if(bw >= f[1].bw)
+    f[1] = f[2] = s;
+  else if(bw >= f[2].bw)
+    f[2] = s;
+
+  /* Age the samples so that each covers a part of the window */
+  dt = s.round - f[0].round;
+  if(dt > BBR_BW_ROUNDS){
+    f[0] = f[1];
+    f[1] = f[2];
+    f[2] = s;
+    if(s.round - f[0].round > BBR_BW_ROUNDS){
+      f[0] = f[1];
+      f[1] = f[2];
+    }
+  }
+  else if(f[1].round == f[0].round && dt > BBR_BW_ROUNDS / 4)
+    f[1] = f[2] = s;
+  else if(f[2].round == f[1].round && dt > BBR_BW_ROUNDS / 2)
+    f[2] = s;
+}
+
+/* The amount of data the model says fits in the pipe, scaled by gain */
+static size_t
+bbr_inflight (const microtcp_sock_t *socket, const bbr_t *bbr, uint32_t gain)
+{
+  uint64_t bdp;
+
+  /* No RTT sample yet: there is no model to go by */
+  if(bbr->min_rtt_us == 0 || bbr_max_bw(bbr) == 0)
+    return microtcp_init_cwnd(socket);
+  bdp = bbr_max_bw(bbr) * bbr->min_rtt_us / 1000000;
+  return bdp * gain / BBR_UNIT;
+}
+
+static void
+bbr_set_mode (bbr_t *bbr, bbr_mode_t mode, uint64_t now)
+{
+  bbr->mode = mode;
+  switch(mode){
+    case BBR_STARTUP:
+      bbr->pacing_gain = BBR_HIGH_GAIN;
+      bbr->cwnd_gain = BBR_HIGH_GAIN;
+      break;
+    case BBR_DRAIN:
+      bbr->pacing_gain = BBR_DRAIN_GAIN;
+      bbr->cwnd_gain = BBR_HIGH_GAIN;
+      break;
+    case BBR_PROBE_BW:
+      /* Start anywhere but in the draining phase */
+      bbr->cycle_index = (now / 1000) % (BBR_CYCLE_LEN - 1);
+      if(bbr->cycle_index >= 1)
+        bbr->cycle_index += 1;
+      bbr->cycle_stamp = now;
+      bbr->pacing_gain = pacing_gain_cycle[bbr->cycle_index];
+      bbr->cwnd_gain = BBR_CWND_GAIN;
+      break;
+    case BBR_PROBE_RTT:
+      bbr->pacing_gain = BBR_UNIT;
+      bbr->cwnd_gain = BBR_UNIT;
+      break;
+  }
+}
+
+static void
+bbr_init (microtcp_sock_t *socket)
+{
+  bbr_t *bbr = MICROTCP_CC_PRIV(socket, bbr_t);
+
+  /* Losses do not end STARTUP, the bandwidth plateau does */
+  socket->ssthresh = (size_t)-1 / 2;
+  bbr_set_mode(bbr, BBR_STARTUP, 0);
+}
+
+/* Moves to the next pacing gain of PROBE_BW once a min RTT has passed.
+   The probing phase lasts until the extra data is really in flight, the
+   draining phase ends early once the queue is gone */
+static void
+bbr_update_cycle (microtcp_sock_t *socket, bbr_t *bbr, const microtcp_ack_sample_t *sample)
+{
+  int advance;
+
+  if(bbr->mode != BBR_PROBE_BW)
+    return;
+
+  advance = sample->now_us - bbr->cycle_stamp > bbr->min_rtt_us;
+  if(bbr->pacing_gain > BBR_UNIT)
+    advance = advance && sample->prior_in_flight >= bbr_inflight(socket, bbr, bbr->pacing_gain);
+  else if(bbr->pacing_gain < BBR_UNIT)
+    advance = advance || socket->bytes_in_flight <= bbr_inflight(socket, bbr, BBR_UNIT);
+  if(!advance)
+    return;
+
+  bbr->cycle_index = (bbr->cycle_index + 1) % BBR_CYCLE_LEN;
+  bbr->cycle_stamp = sample->now_us;
+  bbr->pacing_gain = pacing_gain_cycle[bbr->cycle_index];
+}
+
+/* STARTUP is over when three rounds in a row grew the bandwidth by less
+   than a quarter */
+static void
+bbr_check_full_bw (bbr_t *bbr, const microtcp_ack_sample_t *sample)
+{
+  if(bbr->filled_pipe || !bbr->round_start || sample->is_app_limited)
+    return;
+  if(bbr_max_bw(bbr) * BBR_UNIT >= bbr->full_bw * BBR_FULL_BW_THRESH){
+    bbr->full_bw = bbr_max_bw(bbr);
+    bbr->full_bw_count = 0;
+    return;
+  }
+  if(++bbr->full_bw_count >= BBR_FULL_BW_ROUNDS)
+    bbr->filled_pipe = 1;
+}
+
+static void
+bbr_check_drain (microtcp_sock_t *socket, bbr_t *bbr, uint64_t now)
+{
+  if(bbr->mode == BBR_STARTUP && bbr->filled_pipe)
+    bbr_set_mode(bbr, BBR_DRAIN, now);
+  if(bbr->mode == BBR_DRAIN && socket->bytes_in_flight <= bbr_inflight(socket, bbr, BBR_UNIT))
+    bbr_set_mode(bbr, BBR_PROBE_BW, now);
+}
+
+/* Keeps the min RTT filter fresh: when it expires, PROBE_RTT holds at most
+   BBR_MIN_CWND in flight for BBR_PROBE_RTT_US and at least a round, so that
+   the queue drains and the RTT can be measured again */
+static void
+bbr_update_min_rtt (microtcp_sock_t *socket, bbr_t *bbr, const microtcp_ack_sample_t *sample)
+{
+  int expired = bbr->min_rtt_us != 0 && sample->now_us - bbr->min_rtt_stamp > BBR_MIN_RTT_WIN_US;
+
+  if(sample->rtt_us != 0 && (bbr->min_rtt_us == 0 || sample->rtt_us <= bbr->min_rtt_us || expired)){
+    bbr->min_rtt_us = sample->rtt_us;
+    bbr->min_rtt_stamp = sample->now_us;
+  }
+
+  if(expired && bbr->mode != BBR_PROBE_RTT){
+    bbr->prior_cwnd = socket->cwnd;
+    bbr_set_mode(bbr, BBR_PROBE_RTT, sample->now_us);
+    bbr->probe_rtt_done_us = 0;
+  }
+  if(bbr->mode != BBR_PROBE_RTT)
+    return;
+
+  if(bbr->probe_rtt_done_us == 0){
+    if(socket->bytes_in_flight <= BBR_MIN_CWND(socket)){
+      bbr->probe_rtt_done_us = sample->now_us + BBR_PROBE_RTT_US;
+      bbr->probe_rtt_round_done = 0;
+      bbr->next_round_delivered = socket->delivered;
+    }
+    return;
+  }
+  if(bbr->round_start)
+    bbr->probe_rtt_round_done = 1;
+  if(bbr->probe_rtt_round_done && sample->now_us >= bbr->probe_rtt_done_us){
+    bbr->min_rtt_stamp = sample->now_us;
+    if(socket->cwnd < bbr->prior_cwnd)
+      socket->cwnd = bbr->prior_cwnd;
+    bbr_set_mode(bbr, bbr->filled_pipe ? BBR_PROBE_BW : BBR_STARTUP, sample->now_us);
+  }
+}
+
+static void
+bbr_set_cwnd (microtcp_sock_t *socket, bbr_t *bbr, const microtcp_ack_sample_t *sample)
+{
+  size_t target = bbr_inflight(socket, bbr, bbr->cwnd_gain);
+
+  /* Leave the window of fast recovery or the timeout to the core */
+  if(sample->in_recovery)
+    return;
+  if(bbr->restore_cwnd && SEQ_GEQ(socket->snd_una, socket->recover)){
+    bbr->restore_cwnd = 0;
+    if(socket->cwnd < bbr->prior_cwnd)
+      socket->cwnd = bbr->prior_cwnd;
+  }
+
+  /* Grow towards the target, only STARTUP may overshoot it */
+  if(bbr->filled_pipe){
+    socket->cwnd += sample->acked;
+    if(socket->cwnd > target)
+      socket->cwnd = target;
+  }
+  else if(socket->cwnd < target || socket->delivered < microtcp_init_cwnd(socket))
+    socket->cwnd += sample->acked;
+  if(socket->cwnd < BBR_MIN_CWND(socket))
+    socket->cwnd = BBR_MIN_CWND(socket);
+  if(bbr->mode == BBR_PROBE_RTT && socket->cwnd > BBR_MIN_CWND(socket))
+    socket->cwnd = BBR_MIN_CWND(socket);
+}
+
+static void
+bbr_on_ack (microtcp_sock_t *socket, const microtcp_ack_sample_t *sample)
+{
+  bbr_t *bbr = MICROTCP_CC_PRIV(socket, bbr_t);
+  uint64_t bw;
+
+  /* A round trip ends when data sent after its start is delivered */
+  bbr->round_start = 0;
+  if(sample->delivered && sample->prior_delivered >= bbr->next_round_delivered){
+    bbr->next_round_delivered = socket->delivered;
+    bbr->round_count += 1;
+    bbr->round_start = 1;
+  }
+
+  /* Samples shorter than the min RTT are ACK compression, not bandwidth.
+     Application limited ones only count if they raise the estimate */
+  if(sample->delivered && sample->interval_us >= bbr->min_rtt_us && sample->interval_us){
+    bw = sample->delivered * 1000000 / sample->interval_us;
+    if(!sample->is_app_limited || bw >= bbr_max_bw(bbr))
+      bbr_bw_filter_update(bbr, bw);
+  }
+
+  bbr_update_cycle(socket, bbr, sample);
+  bbr_check_full_bw(bbr, sample);
+  bbr_check_drain(socket, bbr, sample->now_us);
+  bbr_update_min_rtt(socket, bbr, sample);
+  bbr_set_cwnd(socket, bbr, sample);
+}
+
+/* A loss is not a congestion signal for BBR: it only holds the window at
+   what is still in flight while recovering and restores it afterwards */
+static void
+bbr_on_loss (microtcp_sock_t *socket)
+{
+  bbr_t *bbr = MICROTCP_CC_PRIV(socket, bbr_t);
+
+  if(!bbr->restore_cwnd)
+    bbr->prior_cwnd = socket->cwnd;
+  bbr->restore_cwnd = 1;
+  socket->ssthresh = socket->bytes_in_flight > BBR_MIN_CWND(socket) ? socket->bytes_in_flight : BBR_MIN_CWND(socket);
+}
+
+static void
+bbr_on_rto (microtcp_sock_t *socket)
+{
+  bbr_on_loss(socket);
+  socket->cwnd = socket->mss;
+}
+
+static uint64_t
+bbr_pacing_rate (const microtcp_sock_t *socket)
+{
+  const bbr_t *bbr = MICROTCP_CC_PRIV(socket, const bbr_t);
+  uint64_t bw = bbr_max_bw(bbr);
+
+  /* Before the first sample, pace the initial window over the RTT */
+  if(bw == 0)
+    bw = (uint64_t)microtcp_init_cwnd(socket) * 1000000 / (socket->srtt_us ? socket->srtt_us : 1000);
+  return bw * bbr->pacing_gain / BBR_UNIT;
+}
+
+const microtcp_cc_ops_t microtcp_cc_bbr = {
+  .name = "bbr",
+  .init = bbr_init,
+  .on_ack = bbr_on_ack,
+  .on_loss = bbr_on_loss,
+  .on_rto = bbr_on_rto,
+  .pacing_rate = bbr_pacing_rate,
+};
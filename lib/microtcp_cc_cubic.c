@@ -0,0 +1,205 @@
+/*
+ * microtcp, a lightweight implementation of TCP for teaching,
+ * and academic purposes.
+ *
+ * Copyright (C) 2015-2017  Manolis Surligas <surligas@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * CUBIC congestion control (RFC 9438) with HyStart slow start exit.
+ *
+ * After a loss the window grows along a cubic curve centred at W_max, the
+ * window where the loss happened: fast while far below it, flat around it
+ * and fast again while probing above it. Windows are kept in segments.
+ */
+
+#include "microtcp_cc.h"
+#include <math.h>
+
+#define CUBIC_C 0.4
+#define CUBIC_BETA 0.7
+/* Additive increase that matches Reno's average window with CUBIC_BETA */
+#define CUBIC_ALPHA (3.0 * (1.0 - CUBIC_BETA) / (1.0 + CUBIC_BETA))
+
+/* HyStart: RTT samples per round and bounds of the RTT increase that ends slow start */
+#define HYSTART_MIN_SAMPLES 8
+#define HYSTART_MIN_ETA_US 4000
+#define HYSTART_MAX_ETA_US 16000
+
+typedef struct
+{
+  double w_max;                 /**< Window before the last reduction */
+  double prior_w_max;           /**< w_max before the last reduction, for undo */
+  double k;                     /**< Seconds the curve needs to reach w_max */
+  double w_est;                 /**< Window Reno would have reached */
+  uint64_t epoch_start_us;      /**< Start of the current growth epoch, 0 if none */
+
+  uint32_t round_end;           /**< The slow start round ends when this is acknowledged */
+  uint8_t round_started;        /**< round_end is valid */
+  uint64_t last_round_min_rtt;  /**< Lowest RTT of the previous round */
+  uint64_t curr_round_min_rtt;  /**< Lowest RTT of the current round so far */
+  uint32_t round_samples;
+} cubic_t;
+
+MICROTCP_CC_PRIV_CHECK(cubic_t);
+
+static void
+cubic_init (microtcp_sock_t *socket)
+{
+  /* HyStart, not a fixed threshold, decides when slow start is over */
+  socket->ssthresh = (size_t)-1 / 2;
+}
+
+/* Delay based slow start exit: once the RTT of a round grows clearly
+   above the one of the previous round, the queue at the bottleneck is
+   building up and the window is big enough */
+static void
+hystart_update (microtcp_sock_t *socket, cubic_t *ca, uint64_t rtt_us)
+{
+  uint64_t eta;
+
+  /* The sequence numbers are only known once connected */
+  if(!ca->round_started || SEQ_GEQ(socket->snd_una, ca->round_end)){
+    ca->round_started = 1;
+    ca->round_end = socket->seq_number;
+    ca->last_round_min_rtt = ca->curr_round_min_rtt;
+    ca->curr_round_min_rtt = 0;
+    ca->round_samples = 0;
+  }
+  if(rtt_us == 0)
+    return;
+
+  if(ca->curr_round_min_rtt == 0 || rtt_us < ca->curr_round_min_rtt)
+    ca->curr_round_min_rtt = rtt_us;
+  ca->round_samples += 1;
+
+  if(ca->round_samples < HYSTART_MIN_SAMPLES || ca->last_round_min_rtt == 0)
+    return;
+  eta = ca->last_round_min_rtt / 8;
+  if(eta < HYSTART_MIN_ETA_US)
+    eta = HYSTART_MIN_ETA_US;
+  if(eta > HYSTART_MAX_ETA_US)
+    eta = HYSTART_MAX_ETA_US;
+  if(ca->curr_round_min_rtt >= ca->last_round_min_rtt + eta)
+    socket->ssthresh = socket->cwnd;
+}
+
+static void
+cubic_on_ack (microtcp_sock_t *socket, const microtcp_ack_sample_t *sample)
+{
+  cubic_t *ca = MICROTCP_CC_PRIV(socket, cubic_t);
+  double cwnd, t, w_cubic, target, rtt;
+
+  if(sample->in_recovery)
+    return;
+
+  if(socket->cwnd < socket->ssthresh){
+    socket->cwnd += microtcp_abc_acked(socket, sample->acked);
+    hystart_update(socket, ca, sample->rtt_us);
+    return;
+  }
+
+  cwnd = (double)socket->cwnd / socket->mss;
+  if(ca->epoch_start_us == 0){
+    ca->epoch_start_us = sample->now_us;
+    if(ca->w_max < cwnd){
+      /* No loss to converge to, probe from here */
+      ca->w_max = cwnd;
+      ca->k = 0;
+    }
+    else
+      ca->k = cbrt((ca->w_max - cwnd) / CUBIC_C);
+    ca->w_est = cwnd;
+  }
+
+  rtt = socket->srtt_us * 1e-6;
+  t = (sample->now_us - ca->epoch_start_us) * 1e-6;
+  w_cubic = CUBIC_C * pow(t - ca->k, 3) + ca->w_max;
+
+  /* TCP friendly region: never grow slower than Reno would */
+  ca->w_est += CUBIC_ALPHA * sample->acked / socket->mss / cwnd;
+  if(w_cubic < ca->w_est){
+    if(ca->w_est > cwnd)
+      socket->cwnd = ca->w_est * socket->mss;
+    return;
+  }
+
+  /* Aim at where the curve will be one RTT from now, by at most 1.5 times
+     the window per RTT */
+  target = CUBIC_C * pow(t + rtt - ca->k, 3) + ca->w_max;
+  if(target > 1.5 * cwnd)
+    target = 1.5 * cwnd;
+  if(target > cwnd)
+    socket->cwnd += (size_t)((target - cwnd) / cwnd * sample->acked);
+}
+
+/* Window reduction shared by fast retransmit and timeouts */
+static void
+cubic_reduce (microtcp_sock_t *socket)
+{
+  cubic_t *ca = MICROTCP_CC_PRIV(socket, cubic_t);
+  size_t flight_size = microtcp_flight_size(socket);
+  double cwnd;
+
+  /* An application limited sender may have a cwnd far above what it
+     ever used, only the part in use counts */
+  cwnd = (double)(socket->cwnd < flight_size ? socket->cwnd : flight_size) / socket->mss;
+
+  /* Fast convergence: a flow that lost below its previous maximum
+     releases bandwidth to newer flows */
+  ca->prior_w_max = ca->w_max;
+  if(cwnd < ca->w_max)
+    ca->w_max = cwnd * (1.0 + CUBIC_BETA) / 2.0;
+  else
+    ca->w_max = cwnd;
+  ca->epoch_start_us = 0;
+
+  socket->ssthresh = (size_t)(cwnd * CUBIC_BETA * socket->mss);
+  if(socket->ssthresh < 2 * socket->mss)
+    socket->ssthresh = 2 * socket->mss;
+}
+
+static void
+cubic_on_loss (microtcp_sock_t *socket)
+{
+  cubic_reduce(socket);
+}
+
+static void
+cubic_on_rto (microtcp_sock_t *socket)
+{
+  cubic_reduce(socket);
+  socket->cwnd = socket->mss;
+}
+
+static void
+cubic_undo (microtcp_sock_t *socket)
+{
+  cubic_t *ca = MICROTCP_CC_PRIV(socket, cubic_t);
+
+  if(ca->prior_w_max > ca->w_max)
+    ca->w_max = ca->prior_w_max;
+  ca->epoch_start_us = 0;
+}
+
+const microtcp_cc_ops_t microtcp_cc_cubic = {
+  .name = "cubic",
+  .init = cubic_init,
+  .on_ack = cubic_on_ack,
+  .on_loss = cubic_on_loss,
+  .on_rto = cubic_on_rto,
+  .undo = cubic_undo,
+};
@@ -0,0 +1,119 @@
+/*
+ * microtcp, a lightweight implementation of TCP for teaching,
+ * and academic purposes.
+ *
+ * Copyright (C) 2015-2017  Manolis Surligas <surligas@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * DCTCP congestion control (RFC 8257). The network marks packets instead
+ * of dropping them, and the sender estimates the fraction of marked data,
+ * alpha, once per round trip. On marks it reduces the window by alpha / 2
+ * instead of halving it: a few marks trim the window slightly, a fully
+ * marked round halves it like a loss. Losses are handled as in Reno.
+ */
+
+#include "microtcp_cc.h"
+
+/* alpha is a fixed point fraction in units of DCTCP_ALPHA_UNIT */
+#define DCTCP_ALPHA_UNIT 1024
+/* Weight of the new fraction in the alpha average, as a shift: g = 1/16 */
+#define DCTCP_G_SHIFT 4
+
+typedef struct
+{
+  uint32_t alpha;               /**< Moving average of the marked fraction */
+  uint64_t acked_bytes;         /**< Bytes acknowledged in the current round */
+  uint64_t marked_bytes;        /**< Part of acked_bytes acknowledged with ECE */
+  uint32_t round_end;           /**< The round ends when this is acknowledged */
+  uint32_t cwr_end;             /**< No new reduction until this is acknowledged */
+  uint8_t round_started;        /**< round_end is valid */
+  uint8_t in_cwr;               /**< The window was reduced in the current round */
+} dctcp_t;
+
+MICROTCP_CC_PRIV_CHECK(dctcp_t);
+
+static void
+dctcp_init (microtcp_sock_t *socket)
+{
+  dctcp_t *dctcp = MICROTCP_CC_PRIV(socket, dctcp_t);
+
+  /* Start cautious: the first marks halve the window */
+  dctcp->alpha = DCTCP_ALPHA_UNIT;
+}
+
+static void
+dctcp_on_ack (microtcp_sock_t *socket, const microtcp_ack_sample_t *sample)
+{
+  dctcp_t *dctcp = MICROTCP_CC_PRIV(socket, dctcp_t);
+  uint64_t fraction;
+
+  dctcp->acked_bytes += sample->acked;
+  if(sample->ece)
+    dctcp->marked_bytes += sample->acked;
+
+  /* Once per round: alpha = (1 - g) * alpha + g * F */
+  if(!dctcp->round_started || SEQ_GEQ(socket->snd_una, dctcp->round_end)){
+    if(dctcp->round_started && dctcp->acked_bytes){
+      fraction = dctcp->marked_bytes * DCTCP_ALPHA_UNIT / dctcp->acked_bytes;
+      dctcp->alpha = dctcp->alpha - (dctcp->alpha >> DCTCP_G_SHIFT)
+                     + (fraction >> DCTCP_G_SHIFT);
+    }
+    dctcp->round_started = 1;
+    dctcp->round_end = socket->seq_number;
+    dctcp->acked_bytes = 0;
+    dctcp->marked_bytes = 0;
+  }
+  if(dctcp->in_cwr && SEQ_GEQ(socket->snd_una, dctcp->cwr_end))
+    dctcp->in_cwr = 0;
+
+  if(sample->in_recovery)
+    return;
+
+  /* At most one reduction per window of data, like for a loss */
+  if(sample->ece && !dctcp->in_cwr){
+    socket->ssthresh = socket->cwnd - (socket->cwnd * dctcp->alpha / DCTCP_ALPHA_UNIT) / 2;
+    if(socket->ssthresh < 2 * socket->mss)
+      socket->ssthresh = 2 * socket->mss;
+    socket->cwnd = socket->ssthresh;
+    dctcp->in_cwr = 1;
+    dctcp->cwr_end = socket->seq_number;
+    return;
+  }
+  microtcp_cc_reno.on_ack(socket, sample);
+}
+
+static void
+dctcp_on_loss (microtcp_sock_t *socket)
+{
+  socket->ssthresh = microtcp_cc_halve(socket);
+}
+
+static void
+dctcp_on_rto (microtcp_sock_t *socket)
+{
+  socket->ssthresh = microtcp_cc_halve(socket);
+  socket->cwnd = socket->mss;
+}
+
+const microtcp_cc_ops_t microtcp_cc_dctcp = {
+  .name = "dctcp",
+  .flags = MICROTCP_CC_FLAG_ECN,
+  .init = dctcp_init,
+  .on_ack = dctcp_on_ack,
+  .on_loss = dctcp_on_loss,
+  .on_rto = dctcp_on_rto,
+};
@@ -0,0 +1,153 @@
+/*
+ * microtcp, a lightweight implementation of TCP for teaching,
+ * and academic purposes.
+ *
+ * Copyright (C) 2015-2017  Manolis Surligas <surligas@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * LEDBAT congestion control (RFC 6817), a scavenger for background
+ * transfers. It measures the queueing delay on the path to the peer, the
+ * one-way delay above its minimum, and steers the window to keep it at
+ * LEDBAT_TARGET_US: it grows while the queue is shorter and shrinks as
+ * soon as another flow fills it, yielding to standard TCP flows.
+ *
+ * The one-way delay comes from the timestamps. Without them the RTT above
+ * its minimum is used, which also counts the queue of the ACK path.
+ */
+
+#include "microtcp_cc.h"
+
+#define LEDBAT_TARGET_US 25000
+/* The window grows by at most a segment per RTT at zero queueing delay */
+#define LEDBAT_GAIN 1
+/* Delay samples the current delay is the minimum of, to filter noise */
+#define LEDBAT_CURRENT_FILTER 4
+/* Minutes of per minute minimums the base delay is the minimum of */
+#define LEDBAT_BASE_HISTORY 10
+#define LEDBAT_MIN_CWND(socket) (2 * (socket)->mss)
+
+typedef struct
+{
+  uint32_t base_history[LEDBAT_BASE_HISTORY]; /**< Lowest delay of each of the last minutes */
+  uint32_t current[LEDBAT_CURRENT_FILTER]; /**< Most recent delay samples */
+  uint64_t minute_start_us;     /**< When the newest base_history entry started */
+  uint8_t base_index;           /**< Next entry of base_history to start */
+  uint8_t base_count;           /**< Valid entries of base_history */
+  uint8_t current_index;        /**< Next entry of current to overwrite */
+  uint8_t current_count;        /**< Valid entries of current */
+} ledbat_t;
+
+MICROTCP_CC_PRIV_CHECK(ledbat_t);
+
+/* The delays are compared as differences, the clock offset inside them
+   may sit anywhere on the 32-bit circle */
+#define DELAY_LT(a, b) SEQ_LT(a, b)
+
+static void
+ledbat_add_delay (ledbat_t *ledbat, uint32_t delay, uint64_t now)
+{
+  uint32_t *base;
+
+  ledbat->current[ledbat->current_index] = delay;
+  ledbat->current_index = (ledbat->current_index + 1) % LEDBAT_CURRENT_FILTER;
+  if(ledbat->current_count < LEDBAT_CURRENT_FILTER)
+    ledbat->current_count += 1;
+
+  /* A minute later the base delay opens a new entry, so that a route
+     change with a longer delay is eventually accepted */
+  if(ledbat->base_count == 0 || now - ledbat->minute_start_us >= 60000000){
+    ledbat->base_history[ledbat->base_index] = delay;
+    ledbat->base_index = (ledbat->base_index + 1) % LEDBAT_BASE_HISTORY;
+    if(ledbat->base_count < LEDBAT_BASE_HISTORY)
+      ledbat->base_count += 1;
+    ledbat->minute_start_us = now;
+    return;
+  }
+  base = &ledbat->base_history[(ledbat->base_index + LEDBAT_BASE_HISTORY - 1) % LEDBAT_BASE_HISTORY];
+  if(DELAY_LT(delay, *base))
+    *base = delay;
+}
+
+/* The current delay above the base delay. Both rings fill up from their
+   first entry, so the valid entries are the first current_count and
+   base_count ones */
+static uint32_t
+ledbat_queueing_delay (const ledbat_t *ledbat)
+{
+  uint32_t current = ledbat->current[0], base = ledbat->base_history[0];
+  size_t i;
+
+  for(i = 1; i < ledbat->current_count; i++)
+    if(DELAY_LT(ledbat->current[i], current))
+      current = ledbat->current[i];
+  for(i = 1; i < ledbat->base_count; i++)
+    if(DELAY_LT(ledbat->base_history[i], base))
+      base = ledbat->base_history[i];
+  return DELAY_LT(base, current) ? current - base : 0;
+}
+
+static void
+ledbat_on_ack (microtcp_sock_t *socket, const microtcp_ack_sample_t *sample)
+{
+  ledbat_t *ledbat = MICROTCP_CC_PRIV(socket, ledbat_t);
+  int64_t off_target, delta;
+  size_t max_cwnd;
+
+  if(sample->owd_valid)
+    ledbat_add_delay(ledbat, sample->owd_us, sample->now_us);
+  else if(sample->rtt_us != 0)
+    ledbat_add_delay(ledbat, sample->rtt_us, sample->now_us);
+  if(sample->in_recovery || ledbat->current_count == 0)
+    return;
+
+  /* Proportional controller: the further below the target, the faster the
+     window grows, the further above it, the faster it shrinks */
+  off_target = LEDBAT_TARGET_US - (int64_t)ledbat_queueing_delay(ledbat);
+  delta = LEDBAT_GAIN * off_target * sample->acked * socket->mss
+          / ((int64_t)LEDBAT_TARGET_US * socket->cwnd);
+  if(delta < 0 && (size_t)-delta > socket->cwnd - LEDBAT_MIN_CWND(socket))
+    socket->cwnd = LEDBAT_MIN_CWND(socket);
+  else
+    socket->cwnd += delta;
+
+  /* Only a window in use may grow */
+  max_cwnd = sample->prior_in_flight + socket->mss;
+  if(delta > 0 && socket->cwnd > max_cwnd)
+    socket->cwnd = max_cwnd > socket->cwnd - delta ? max_cwnd : socket->cwnd - delta;
+  if(socket->cwnd < LEDBAT_MIN_CWND(socket))
+    socket->cwnd = LEDBAT_MIN_CWND(socket);
+}
+
+static void
+ledbat_on_loss (microtcp_sock_t *socket)
+{
+  socket->ssthresh = socket->cwnd / 2 > LEDBAT_MIN_CWND(socket) ? socket->cwnd / 2 : LEDBAT_MIN_CWND(socket);
+}
+
+static void
+ledbat_on_rto (microtcp_sock_t *socket)
+{
+  ledbat_on_loss(socket);
+  socket->cwnd = socket->mss;
+}
+
+const microtcp_cc_ops_t microtcp_cc_ledbat = {
+  .name = "ledbat",
+  .on_ack = ledbat_on_ack,
+  .on_loss = ledbat_on_loss,
+  .on_rto = ledbat_on_rto,
+};
@@ -0,0 +1,127 @@
+/*
+ * microtcp, a lightweight implementation of TCP for teaching,
+ * and academic purposes.
+ *
+ * Copyright (C) 2015-2017  Manolis Surligas <surligas@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Vegas congestion control: a delay based algorithm. Once per round trip
+ * it compares the throughput the window would give on an empty path
+ * (cwnd / base RTT) with the one it actually gets (cwnd / RTT). The
+ * difference is the data sitting in the bottleneck queue, and the window
+ * is adjusted to keep it between VEGAS_ALPHA and VEGAS_BETA segments.
+ */
+
+#include "microtcp_cc.h"
+
+/* Bounds of the queued data, in segments */
+#define VEGAS_ALPHA 2
+#define VEGAS_BETA 4
+/* Queued data that ends slow start */
+#define VEGAS_GAMMA 1
+/* RTT samples a round needs to be trusted; fewer and Reno decides */
+#define VEGAS_MIN_SAMPLES 3
+
+typedef struct
+{
+  uint64_t base_rtt_us;         /**< Lowest RTT ever seen: the propagation delay */
+  uint64_t min_rtt_us;          /**< Lowest RTT of the current round, free of delayed ACK noise */
+  uint32_t samples;             /**< RTT samples of the current round */
+  uint32_t round_end;           /**< The round ends when this is acknowledged */
+  uint8_t round_started;        /**< round_end is valid */
+} vegas_t;
+
+MICROTCP_CC_PRIV_CHECK(vegas_t);
+
+static void
+vegas_on_ack (microtcp_sock_t *socket, const microtcp_ack_sample_t *sample)
+{
+  vegas_t *vegas = MICROTCP_CC_PRIV(socket, vegas_t);
+  size_t cwnd, target, diff;
+
+  if(sample->rtt_us != 0){
+    if(vegas->base_rtt_us == 0 || sample->rtt_us < vegas->base_rtt_us)
+      vegas->base_rtt_us = sample->rtt_us;
+    if(vegas->samples == 0 || sample->rtt_us < vegas->min_rtt_us)
+      vegas->min_rtt_us = sample->rtt_us;
+    vegas->samples += 1;
+  }
+
+  if(sample->in_recovery)
+    return;
+
+  /* The sequence numbers are only known once connected */
+  if(vegas->round_started && SEQ_LT(socket->snd_una, vegas->round_end)){
+    if(socket->cwnd < socket->ssthresh)
+      socket->cwnd += microtcp_abc_acked(socket, sample->acked);
+    return;
+  }
+  vegas->round_started = 1;
+  vegas->round_end = socket->seq_number;
+
+  if(vegas->samples < VEGAS_MIN_SAMPLES){
+    microtcp_cc_reno.on_ack(socket, sample);
+    vegas->samples = 0;
+    return;
+  }
+
+  /* The window the base RTT would need for the rate of this round, and
+     the segments queued on top of it */
+  cwnd = socket->cwnd / socket->mss;
+  target = socket->cwnd * vegas->base_rtt_us / vegas->min_rtt_us / socket->mss;
+  diff = cwnd - target;
+
+  if(socket->cwnd < socket->ssthresh){
+    if(diff > VEGAS_GAMMA){
+      /* The queue is building up: leave slow start at the window that
+         keeps it short */
+      if(socket->cwnd > (target + 1) * socket->mss)
+        socket->cwnd = (target + 1) * socket->mss;
+      socket->ssthresh = socket->cwnd > socket->mss ? socket->cwnd - socket->mss : socket->mss;
+    }
+    else
+      socket->cwnd += microtcp_abc_acked(socket, sample->acked);
+  }
+  else if(diff > VEGAS_BETA)
+    socket->cwnd -= socket->mss;
+  else if(diff < VEGAS_ALPHA)
+    socket->cwnd += socket->mss;
+
+  if(socket->cwnd < 2 * socket->mss)
+    socket->cwnd = 2 * socket->mss;
+  vegas->samples = 0;
+}
+
+static void
+vegas_on_loss (microtcp_sock_t *socket)
+{
+  socket->ssthresh = microtcp_cc_halve(socket);
+}
+
+static void
+vegas_on_rto (microtcp_sock_t *socket)
+{
+  socket->ssthresh = microtcp_cc_halve(socket);
+  socket->cwnd = socket->mss;
+}
+
+const microtcp_cc_ops_t microtcp_cc_vegas = {
+  .name = "vegas",
+  .on_ack = vegas_on_ack,
+  .on_loss = vegas_on_loss,
+  .on_rto = vegas_on_rto,
+};
@@ -0,0 +1,40 @@
+#!/bin/sh
+#
+# microtcp, a lightweight implementation of TCP for teaching,
+# and academic purposes.
+#
+# Copyright (C) 2015-2017  Manolis Surligas <surligas@gmail.com>
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+
+# Runs one client/server test: the server on port, the client through
+# the relay it starts on port + 1. Fails unless both sides pass.
+#
+# Usage: client_server_test.sh <server> <client> <port> <test>
+
+if [ $# -ne 4 ]; then
+  echo "Usage: $0 <server> <client> <port> <test>" >&2
+  exit 1
+fi
+
+"$1" "$3" "$4" &
+server=$!
+sleep 0.2
+"$2" "$3" "$4"
+client=$?
+wait $server
+server=$?
+
+[ $client -eq 0 ] && [ $server -eq 0 ]
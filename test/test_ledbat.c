@@ -0,0 +1,110 @@
+/*
+ * microtcp, a lightweight implementation of TCP for teaching,
+ * and academic purposes.
+ *
+ * Copyright (C) 2015-2017  Manolis Surligas <surligas@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Feeds LEDBAT a known sequence of one-way delays and checks the queueing
+ * delay it derives from them. The module is included whole to reach its
+ * static helpers. Every sequence runs with several clock offsets between
+ * the peers, which the delays carry and the estimate must cancel out.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../lib/microtcp_cc_ledbat.c"
+
+#define MINUTE_US 60000000ULL
+
+static int failures;
+
+static void
+add_delays (ledbat_t *ledbat, uint32_t offset, uint32_t delay, size_t count, uint64_t now)
+{
+  size_t i;
+
+  for(i = 0; i < count; i++)
+    ledbat_add_delay(ledbat, offset + delay, now + i);
+}
+
+static void
+expect_qdelay (const ledbat_t *ledbat, uint32_t offset, uint32_t expected, const char *step)
+{
+  uint32_t qdelay = ledbat_queueing_delay(ledbat);
+
+  if(qdelay != expected){
+    fprintf(stderr, "offset %#010x, %s: queueing delay %u us, expected %u us\n",
+            offset, step, qdelay, expected);
+    failures++;
+  }
+}
+
+static void
+run_sequence (uint32_t offset)
+{
+  ledbat_t ledbat;
+  uint64_t now = 1000000;
+  int minute;
+
+  memset(&ledbat, 0, sizeof(ledbat));
+
+  add_delays(&ledbat, offset, 10000, 1, now);
+  expect_qdelay(&ledbat, offset, 0, "first sample");
+
+  /* The current delay is the minimum of the last LEDBAT_CURRENT_FILTER
+     samples, so a queue shows once it lasts that long */
+  add_delays(&ledbat, offset, 14000, LEDBAT_CURRENT_FILTER - 1, now);
+  expect_qdelay(&ledbat, offset, 0, "queue shorter than the filter");
+  add_delays(&ledbat, offset, 14000, 1, now);
+  expect_qdelay(&ledbat, offset, 4000, "4 ms queue");
+
+  /* A shorter delay lowers the base delay of the current minute */
+  add_delays(&ledbat, offset, 9000, 1, now);
+  expect_qdelay(&ledbat, offset, 0, "new minimum");
+  add_delays(&ledbat, offset, 20000, LEDBAT_CURRENT_FILTER, now);
+  expect_qdelay(&ledbat, offset, 11000, "11 ms queue");
+
+  /* After a route change to a longer path the old minimum still counts
+     for LEDBAT_BASE_HISTORY minutes, then the new one takes over */
+  for(minute = 1; minute < LEDBAT_BASE_HISTORY; minute++){
+    add_delays(&ledbat, offset, 30000, LEDBAT_CURRENT_FILTER, now + minute * MINUTE_US);
+    expect_qdelay(&ledbat, offset, 21000, "longer path, old base delay");
+  }
+  add_delays(&ledbat, offset, 30000, LEDBAT_CURRENT_FILTER, now + minute * MINUTE_US);
+  expect_qdelay(&ledbat, offset, 0, "longer path, base delay expired");
+  add_delays(&ledbat, offset, 32000, LEDBAT_CURRENT_FILTER, now + minute * MINUTE_US);
+  expect_qdelay(&ledbat, offset, 2000, "2 ms queue on the longer path");
+}
+
+int
+main(int argc, char **argv)
+{
+  const uint32_t offsets[] = { 0, 0x10000000, 0x7ffff000, 0x90000000, 0xfffff000 };
+  size_t i;
+
+  for(i = 0; i < sizeof(offsets) / sizeof(offsets[0]); i++)
+    run_sequence(offsets[i]);
+  if(failures){
+    fprintf(stderr, "%d checks failed\n", failures);
+    return EXIT_FAILURE;
+  }
+  printf("LEDBAT queueing delay checks passed\n");
+  return EXIT_SUCCESS;
+}
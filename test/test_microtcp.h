@@ -0,0 +1,60 @@
+/*
+ * microtcp, a lightweight implementation of TCP for teaching,
+ * and academic purposes.
+ *
+ * Copyright (C) 2015-2017  Manolis Surligas <surligas@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Definitions shared by test_microtcp_server and test_microtcp_client.
+ * Both are started with the same port and test name and run that test
+ * against each other on the loopback interface, see client_server_test.sh.
+ * The client talks to the server through a relay it forks, which
+ * listens on the port after the server's and may alter the traffic.
+ */
+
+#ifndef TEST_TEST_MICROTCP_H_
+#define TEST_TEST_MICROTCP_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* A test that has not finished by then hangs */
+#define TEST_TIMEOUT_S 30
+
+/* Bytes the client sends in the bulk transfer tests */
+#define TEST_BULK_LEN (2u << 20)
+
+/* Bytes the client sends in the tail_loss test, a short transfer with
+   a partial last segment */
+#define TEST_TAIL_LEN (20 * 1400 + 500)
+
+/* Bytes the client sends when the transfer is not what is tested */
+#define TEST_SHORT_LEN 100000
+
+/* Request/response tests: the client sends TEST_RPC_COUNT requests of
+   TEST_RPC_LEN bytes, each answered with as many */
+#define TEST_RPC_COUNT 40
+#define TEST_RPC_LEN 2800
+
+/* Byte at offset i of the stream the client sends */
+static inline uint8_t
+test_pattern (size_t i)
+{
+  return (uint8_t) (i * 131 + i / 251);
+}
+
+#endif /* TEST_TEST_MICROTCP_H_ */
@@ -19,12 +19,839 @@
  */
 
 /*
- * You can use this file to write a test microTCP client.
- * This file is already inserted at the build system.
+ * The client side of the microTCP client/server tests.
+ *
+ * Usage: test_microtcp_client <port> <test>
+ *
+ * The client forks a relay that listens on port + 1 and forwards every
+ * datagram between the client and the server on port. The relay parses
+ * the microTCP headers, lets the test hold, drop or CE mark segments and
+ * counts what it saw in memory it shares with the client, which checks
+ * the counters once the connection is shut down.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/ip.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+#include "../lib/microtcp.h"
+#include "log.h"
+#include "test_microtcp.h"
+
+#define RELAY_MAX_DATAGRAM 65536
+
+/* How long the relay keeps running after the client has shut down, so
+   the last segments of the connection still reach the server */
+#define RELAY_LINGER_US 200000
+
+/* Longest a held segment waits for the test to release it */
+#define RELAY_HOLD_US 5000
+
+/* Held segments whose retransmissions the relay tells apart */
+#define RELAY_MAX_HELD 1024
+
+typedef enum
+{
+  RELAY_FORWARD,
+  RELAY_DROP,
+  RELAY_HOLD                    /* Forwarded once the test releases it */
+} relay_verdict_t;
+
+/**
+ * A datagram passing through the relay
+ */
+typedef struct
+{
+  int from_client;
+  int retransmission;           /* Client data below the highest seen so far */
+  microtcp_header_t header;     /* In host byte order */
+  uint8_t tos;                  /* IP TOS byte it arrived with, forwarded as is */
+  uint8_t buf[RELAY_MAX_DATAGRAM];
+  size_t len;
+} relay_packet_t;
+
+/**
+ * The relay's state. It lives in memory shared with the client, so the
+ * client reads the counters after the relay has stopped.
+ */
+typedef struct
+{
+  int sd;
+  struct sockaddr_in server;
+  struct sockaddr_in client;
+  int client_known;
+
+  relay_packet_t held;          /* At most one segment is held at a time */
+  int holding;
+  uint64_t held_us;
+  int release;                  /* Set by a test to forward the held segment */
+
+  /* Counters of client to server data segments */
+  uint32_t client_isn;          /* Sequence number of the first byte of client data */
+  uint32_t client_max_end;      /* Highest sequence number of client data seen */
+  size_t data_segments;         /* Carrying new data */
+  size_t retransmissions;       /* Carrying data below client_max_end */
+  size_t held_segments;
+  uint32_t held_seq[RELAY_MAX_HELD];
+  size_t held_retransmissions;  /* Retransmissions of segments once held */
+  size_t short_segments;        /* Carrying new data, less than an MSS */
+  size_t dropped;
+
+  size_t server_pure_acks;       /* Server to client, no data, SYN or FIN */
+
+  /* ECN: client data segments arriving ECN capable and marked CE by the
+     relay, server segments echoing a mark with ECE */
+  size_t ect_segments;
+  size_t ce_marked;
+  size_t server_ece;
+  size_t server_ece_data;       /* ECE on a data segment, not a pure ACK */
+  size_t server_ece_unmarked;   /* ECE before any segment was marked */
+  int server_last_ece;          /* ECE on the last server segment */
+
+  /* Flow control: the right edge of the server's window, and window
+     probes of the client, pure ACKs below the server's ACK */
+  uint8_t server_wscale;
+  int server_edge_known;
+  uint32_t server_edge;
+  uint32_t server_ack;
+  size_t zero_windows;
+  size_t dropped_updates;
+  size_t silly_updates;         /* The edge moved by less than SWS avoidance allows */
+  size_t probes;
+
+  /* Control segments, whether forwarded or not */
+  size_t syns;
+  size_t synacks;
+  size_t handshake_acks;        /* Pure ACKs of the client before any data */
+  size_t client_fins;
+  size_t server_fins;
+} relay_t;
+
+static uint64_t
+now_us (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static int
+control_bit (const microtcp_header_t *header, int bit)
+{
+  return (header->control >> bit) & 1;
+}
+
+static void
+relay_forward (relay_t *relay, const relay_packet_t *packet)
+{
+  const struct sockaddr_in *to = packet->from_client ? &relay->server : &relay->client;
+  union
+  {
+    char buf[CMSG_SPACE(sizeof(int))];
+    struct cmsghdr align;
+  } control;
+  struct iovec iov = { (void *) packet->buf, packet->len };
+  struct msghdr msg;
+  struct cmsghdr *cmsg;
+  int tos = packet->tos;
+
+  memset (&msg, 0, sizeof(msg));
+  msg.msg_name = (void *) to;
+  msg.msg_namelen = sizeof(*to);
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  if (tos) {
+    memset (&control, 0, sizeof(control));
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+    cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = IPPROTO_IP;
+    cmsg->cmsg_type = IP_TOS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy (CMSG_DATA(cmsg), &tos, sizeof(int));
+  }
+  sendmsg (relay->sd, &msg, 0);
+}
+
+/*
+ * Reads a datagram into packet. Returns 0 if it carries a microTCP
+ * header and the relay knows where to send it, -1 otherwise
+ */
+static int
+relay_receive (relay_t *relay, relay_packet_t *packet)
+{
+  union
+  {
+    char buf[CMSG_SPACE(sizeof(int))];
+    struct cmsghdr align;
+  } control;
+  struct sockaddr_in from;
+  struct iovec iov = { packet->buf, sizeof(packet->buf) };
+  struct msghdr msg;
+  struct cmsghdr *cmsg;
+  const microtcp_header_t *nbo;
+  ssize_t received;
+
+  memset (&msg, 0, sizeof(msg));
+  msg.msg_name = &from;
+  msg.msg_namelen = sizeof(from);
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.buf;
+  msg.msg_controllen = sizeof(control.buf);
+  received = recvmsg (relay->sd, &msg, 0);
+  if (received < (ssize_t) sizeof(microtcp_header_t))
+    return -1;
+  packet->len = received;
+
+  packet->tos = 0;
+  for (cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg))
+    if (cmsg->cmsg_level == IPPROTO_IP && cmsg->cmsg_type == IP_TOS)
+      packet->tos = *(uint8_t *) CMSG_DATA(cmsg);
+
+  packet->from_client = from.sin_port != relay->server.sin_port;
+  if (packet->from_client && !relay->client_known) {
+    relay->client = from;
+    relay->client_known = 1;
+  }
+  if (!packet->from_client && !relay->client_known)
+    return -1;
+
+  nbo = (const microtcp_header_t *) packet->buf;
+  packet->header.seq_number = ntohl (nbo->seq_number);
+  packet->header.ack_number = ntohl (nbo->ack_number);
+  packet->header.control = ntohs (nbo->control);
+  packet->header.window = ntohs (nbo->window);
+  packet->header.data_len = ntohl (nbo->data_len);
+  packet->header.future_use0 = ntohl (nbo->future_use0);
+  packet->header.future_use1 = ntohl (nbo->future_use1);
+  packet->header.future_use2 = ntohl (nbo->future_use2);
+  return 0;
+}
+
+/* Keeps the counters every test shares */
+static void
+relay_count (relay_t *relay, relay_packet_t *packet)
+{
+  uint32_t seq = packet->header.seq_number;
+  uint32_t end = seq + packet->header.data_len;
+  size_t i;
+
+  packet->retransmission = 0;
+  if (control_bit (&packet->header, SYN_F))
+    *(control_bit (&packet->header, ACK_F) ? &relay->synacks : &relay->syns) += 1;
+  else if (control_bit (&packet->header, FIN_F))
+    *(packet->from_client ? &relay->client_fins : &relay->server_fins) += 1;
+  else if (packet->from_client && packet->header.data_len == 0
+           && relay->data_segments == 0 && relay->syns > 0)
+    relay->handshake_acks++;
+  else if (!packet->from_client && packet->header.data_len == 0
+           && control_bit (&packet->header, ACK_F))
+    relay->server_pure_acks++;
+
+  if (!packet->from_client || packet->header.data_len == 0)
+    return;
+  if (relay->data_segments == 0 && relay->retransmissions == 0) {
+    relay->client_isn = seq;
+    relay->client_max_end = seq;
+  }
+  if ((int32_t) (seq - relay->client_max_end) < 0) {
+    packet->retransmission = 1;
+    relay->retransmissions++;
+    for (i = 0; i < relay->held_segments && i < RELAY_MAX_HELD; i++)
+      if (relay->held_seq[i] == seq)
+        relay->held_retransmissions++;
+    return;
+  }
+  relay->client_max_end = end;
+  relay->data_segments++;
+  if (packet->header.data_len < MICROTCP_MSS)
+    relay->short_segments++;
+}
+
+/*
+ * The relay process: forwards datagrams until it is killed, passing each
+ * one through the test's filter first
  */
+static void
+relay_run (relay_t *relay,
+           relay_verdict_t (*filter) (relay_t *relay, relay_packet_t *packet))
+{
+  static relay_packet_t packet;
+  struct pollfd pfd = { relay->sd, POLLIN, 0 };
+  relay_verdict_t verdict;
+
+  for (;;) {
+    if (poll (&pfd, 1, relay->holding ? 1 : -1) < 0 && errno != EINTR)
+      exit (EXIT_FAILURE);
+    if ((pfd.revents & POLLIN) && relay_receive (relay, &packet) == 0) {
+      relay_count (relay, &packet);
+      verdict = filter ? filter (relay, &packet) : RELAY_FORWARD;
+      if (verdict == RELAY_HOLD && !relay->holding) {
+        relay->held = packet;
+        relay->holding = 1;
+        relay->held_us = now_us ();
+        if (relay->held_segments < RELAY_MAX_HELD)
+          relay->held_seq[relay->held_segments] = packet.header.seq_number;
+        relay->held_segments++;
+      }
+      else if (verdict == RELAY_DROP) {
+        relay->dropped++;
+      }
+      else {
+        relay_forward (relay, &packet);
+      }
+    }
+    if (relay->holding && (relay->release || now_us () - relay->held_us > RELAY_HOLD_US)) {
+      relay_forward (relay, &relay->held);
+      relay->holding = 0;
+      relay->release = 0;
+    }
+  }
+}
+
+/*
+ * Forks the relay between relay_port and server_port. Returns its pid,
+ * or -1 on error
+ */
+static pid_t
+relay_start (relay_t *relay, uint16_t relay_port, uint16_t server_port,
+             relay_verdict_t (*filter) (relay_t *relay, relay_packet_t *packet))
+{
+  struct sockaddr_in sin;
+  int on = 1;
+  pid_t pid;
+
+  relay->sd = socket (AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+  if (relay->sd < 0) {
+    perror ("relay socket");
+    return -1;
+  }
+  setsockopt (relay->sd, IPPROTO_IP, IP_RECVTOS, &on, sizeof(on));
+  memset (&sin, 0, sizeof(sin));
+  sin.sin_family = AF_INET;
+  sin.sin_port = htons (relay_port);
+  sin.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+  if (bind (relay->sd, (struct sockaddr *) &sin, sizeof(sin)) < 0) {
+    perror ("relay bind");
+    return -1;
+  }
+  relay->server = sin;
+  relay->server.sin_port = htons (server_port);
+
+  pid = fork ();
+  if (pid == 0) {
+    relay_run (relay, filter);
+    exit (EXIT_SUCCESS);
+  }
+  if (pid < 0)
+    perror ("fork");
+  return pid;
+}
+
+static int
+send_pattern (microtcp_sock_t *sock, size_t len)
+{
+  uint8_t buffer[10000];
+  size_t sent = 0;
+  size_t chunk;
+  size_t i;
+
+  while (sent < len) {
+    chunk = len - sent < sizeof(buffer) ? len - sent : sizeof(buffer);
+    for (i = 0; i < chunk; i++)
+      buffer[i] = test_pattern (sent + i);
+    if (microtcp_send (sock, buffer, chunk, 0) != (ssize_t) chunk) {
+      LOG_ERROR("Failed to send at byte %zu", sent);
+      return -1;
+    }
+    sent += chunk;
+  }
+  return 0;
+}
+
+static int
+short_send (microtcp_sock_t *sock)
+{
+  return send_pattern (sock, TEST_SHORT_LEN);
+}
+
+#define CHECK(cond)                                                     \
+  do {                                                                  \
+    if (!(cond)) {                                                      \
+      LOG_ERROR("Check failed: %s", #cond);                             \
+      return -1;                                                        \
+    }                                                                   \
+  } while (0)
+
+/*
+ * tail_loss: the last data segment of the transfer is dropped once. No
+ * later segment makes the server send a duplicate ACK, so only a tail
+ * loss probe or the retransmission timer can repair it. Which one does
+ * depends on the scheduling of the processes, so only the repair is
+ * checked, see test_rack for the probe itself.
+ */
+static relay_verdict_t
+tail_loss_filter (relay_t *relay, relay_packet_t *packet)
+{
+  if (!packet->from_client || packet->header.data_len == 0 || relay->dropped > 0
+      || packet->header.seq_number + packet->header.data_len - relay->client_isn != TEST_TAIL_LEN)
+    return RELAY_FORWARD;
+  return RELAY_DROP;
+}
+
+static int
+tail_loss_send (microtcp_sock_t *sock)
+{
+  return send_pattern (sock, TEST_TAIL_LEN);
+}
+
+static int
+tail_loss_check (const microtcp_sock_t *sock, const relay_t *relay)
+{
+  LOG_INFO("%zu segments dropped, %zu retransmissions, %lu segments taken for lost",
+           relay->dropped, relay->retransmissions, (unsigned long) sock->packets_lost);
+  CHECK(relay->dropped == 1);
+  CHECK(relay->retransmissions >= 1);
+  return 0;
+}
+
+/* Sends the whole stream in one call, so the transfer never stops to
+   wait for the ACKs of a call's last segments */
+static int
+bulk_send (microtcp_sock_t *sock)
+{
+  uint8_t *buffer = malloc (TEST_BULK_LEN);
+  size_t i;
+  int ret = 0;
+
+  if (!buffer) {
+    perror ("allocating the stream");
+    return -1;
+  }
+  for (i = 0; i < TEST_BULK_LEN; i++)
+    buffer[i] = test_pattern (i);
+  if (microtcp_send (sock, buffer, TEST_BULK_LEN, 0) != TEST_BULK_LEN)
+    ret = -1;
+  free (buffer);
+  return ret;
+}
+
+/*
+ * reorder: every REORDER_EVERY new data segment is held back until
+ * REORDER_DEPTH later ones have passed it. Nothing is lost, so every
+ * retransmission of a held segment is spurious. The first ones are
+ * expected, the sender should then learn to wait. Retransmissions of
+ * other segments are not counted against it: a stall of the relay
+ * delays a whole flight, more than any reordering window allows.
+ *
+ * The server opens a 64 KB window, so the segments that pass a held one
+ * follow it closely. About one in seven held segments is still
+ * retransmitted, before RACK has learned its window or when the relay
+ * stalls; without DSACK every one of them is. The bound leaves room for
+ * a loaded machine.
+ */
+#define REORDER_EVERY 16
+#define REORDER_DEPTH 3
+
+static relay_verdict_t
+reorder_filter (relay_t *relay, relay_packet_t *packet)
+{
+  static size_t passed;
+
+  if (!packet->from_client || packet->header.data_len == 0
+      || packet->header.seq_number + packet->header.data_len != relay->client_max_end)
+    return RELAY_FORWARD;
+  if (relay->holding) {
+    if (++passed == REORDER_DEPTH)
+      relay->release = 1;
+    return RELAY_FORWARD;
+  }
+  if (relay->data_segments % REORDER_EVERY == 0) {
+    passed = 0;
+    return RELAY_HOLD;
+  }
+  return RELAY_FORWARD;
+}
+
+static int
+reorder_check (const microtcp_sock_t *sock, const relay_t *relay)
+{
+  LOG_INFO("%zu of %zu segments reordered, %zu of them retransmitted, %zu retransmissions in all",
+           relay->held_segments, relay->data_segments, relay->held_retransmissions,
+           relay->retransmissions);
+  CHECK(relay->held_segments > 0);
+  CHECK(sock->rack_reordering_seen);
+  CHECK(relay->held_retransmissions <= relay->held_segments / 2);
+  return 0;
+}
+
+/*
+ * control_loss: the first SYN, SYN-ACK, ACK of the handshake and FIN of
+ * either side are lost. Each must be resent, and the connection still
+ * set up and torn down. The client waits for its data with
+ * microtcp_flush() before it shuts down.
+ */
+static int
+flush_send (microtcp_sock_t *sock)
+{
+  if (send_pattern (sock, TEST_SHORT_LEN) < 0)
+    return -1;
+  if (microtcp_flush (sock, 10000000) != 0) {
+    LOG_ERROR("Data still unacknowledged after microtcp_flush()");
+    return -1;
+  }
+  return 0;
+}
+
+static relay_verdict_t
+control_loss_filter (relay_t *relay, relay_packet_t *packet)
+{
+  const microtcp_header_t *header = &packet->header;
+
+  if (control_bit (header, SYN_F))
+    return (control_bit (header, ACK_F) ? relay->synacks : relay->syns) == 1
+           ? RELAY_DROP : RELAY_FORWARD;
+  if (control_bit (header, FIN_F))
+    return (packet->from_client ? relay->client_fins : relay->server_fins) == 1
+           ? RELAY_DROP : RELAY_FORWARD;
+  if (packet->from_client && header->data_len == 0 && relay->data_segments == 0
+      && relay->handshake_acks == 1)
+    return RELAY_DROP;
+  return RELAY_FORWARD;
+}
+
+static int
+control_loss_check (const microtcp_sock_t *sock, const relay_t *relay)
+{
+  LOG_INFO("%zu SYN, %zu SYN-ACK, %zu handshake ACK, %zu client FIN and %zu server FIN seen",
+           relay->syns, relay->synacks, relay->handshake_acks, relay->client_fins,
+           relay->server_fins);
+  CHECK(relay->syns >= 2);
+  CHECK(relay->synacks >= 2);
+  CHECK(relay->handshake_acks >= 1);
+  CHECK(relay->client_fins >= 2);
+  CHECK(relay->server_fins >= 2);
+  return 0;
+}
+
+/*
+ * small_writes: the client writes its data SMALL_WRITE_LEN bytes at a
+ * time. Nagle's algorithm coalesces the writes, so new data leaves in
+ * full segments. A partial one only leaves with nothing in flight, as
+ * the first write does, when the ACK of everything sent or the Nagle
+ * timer finds it waiting, and at the end of the transfer. On an idle
+ * machine that is the first and the last segment only.
+ */
+#define SMALL_WRITE_LEN 100
+
+static int
+small_writes_send (microtcp_sock_t *sock)
+{
+  uint8_t buffer[SMALL_WRITE_LEN];
+  size_t sent, i;
+
+  for (sent = 0; sent < TEST_SHORT_LEN; sent += SMALL_WRITE_LEN) {
+    for (i = 0; i < SMALL_WRITE_LEN; i++)
+      buffer[i] = test_pattern (sent + i);
+    if (microtcp_send (sock, buffer, SMALL_WRITE_LEN, 0) != SMALL_WRITE_LEN) {
+      LOG_ERROR("Failed to send at byte %zu", sent);
+      return -1;
+    }
+  }
+  if (microtcp_flush (sock, 10000000) != 0) {
+    LOG_ERROR("Data still unacknowledged after microtcp_flush()");
+    return -1;
+  }
+  return 0;
+}
+
+static int
+small_writes_check (const microtcp_sock_t *sock, const relay_t *relay)
+{
+  LOG_INFO("%zu of %zu data segments shorter than an MSS",
+           relay->short_segments, relay->data_segments);
+  CHECK(relay->data_segments >= TEST_SHORT_LEN / MICROTCP_MSS);
+  CHECK(relay->short_segments <= relay->data_segments / 10);
+  return 0;
+}
+
+/*
+ * delack, nodelack: a bulk transfer without loss or reordering, to a
+ * server that acknowledges every second segment, or every segment. On a
+ * loaded machine a late ACK can still set off a spurious retransmission,
+ * which the server acknowledges at once
+ */
+static int
+delack_check (const microtcp_sock_t *sock, const relay_t *relay)
+{
+  LOG_INFO("%zu ACKs for %zu data segments, %zu retransmissions",
+           relay->server_pure_acks, relay->data_segments, relay->retransmissions);
+  CHECK(relay->retransmissions <= relay->data_segments / 10);
+  CHECK(relay->server_pure_acks * 100
+        <= relay->data_segments * 60 + relay->retransmissions * 100);
+  return 0;
+}
+
+static int
+nodelack_check (const microtcp_sock_t *sock, const relay_t *relay)
+{
+  LOG_INFO("%zu ACKs for %zu data segments, %zu retransmissions",
+           relay->server_pure_acks, relay->data_segments, relay->retransmissions);
+  CHECK(relay->retransmissions <= relay->data_segments / 10);
+  CHECK(relay->server_pure_acks >= relay->data_segments);
+  return 0;
+}
+
+/*
+ * persist: the server's reader stalls until its window closes, then
+ * reads one byte, which must not open the window, then stalls again
+ * and finally reads everything. The relay drops the first window update
+ * after the window closed, so only a probe of the client reopens it.
+ * The right edge of the window must move by at least PERSIST_SWS_STEP,
+ * the smaller of the MSS and half of the server's buffer.
+ */
+#define PERSIST_SWS_STEP (MICROTCP_MIN_RECVBUF_LEN / 2)
+
+static relay_verdict_t
+persist_filter (relay_t *relay, relay_packet_t *packet)
+{
+  const microtcp_header_t *header = &packet->header;
+  uint32_t edge;
+  int opened;
+
+  if (packet->from_client) {
+    if (header->data_len == 0 && !control_bit (header, SYN_F) && !control_bit (header, FIN_F)
+        && (int32_t) (header->seq_number - relay->server_ack) < 0)
+      relay->probes++;
+    return RELAY_FORWARD;
+  }
+
+  if (control_bit (header, SYN_F)) {
+    if (header->future_use0 & MICROTCP_OPT_WSCALE)
+      relay->server_wscale = MICROTCP_OPT_WSCALE_SHIFT(header->future_use0);
+    return RELAY_FORWARD;
+  }
+  if (!control_bit (header, ACK_F))
+    return RELAY_FORWARD;
+
+  relay->server_ack = header->ack_number;
+  edge = header->ack_number + ((uint32_t) header->window << relay->server_wscale);
+  opened = relay->server_edge_known && (int32_t) (edge - relay->server_edge) > 0;
+  if (opened && edge - relay->server_edge < PERSIST_SWS_STEP)
+    relay->silly_updates++;
+  if (header->window == 0)
+    relay->zero_windows++;
+  relay->server_edge = edge;
+  relay->server_edge_known = 1;
+
+  if (opened && relay->zero_windows > 0 && relay->dropped_updates == 0
+      && header->data_len == 0 && !control_bit (header, FIN_F)) {
+    relay->dropped_updates++;
+    return RELAY_DROP;
+  }
+  return RELAY_FORWARD;
+}
+
+static int
+persist_check (const microtcp_sock_t *sock, const relay_t *relay)
+{
+  LOG_INFO("%zu zero windows, %zu probes, %zu silly window updates",
+           relay->zero_windows, relay->probes, relay->silly_updates);
+  CHECK(relay->zero_windows > 0);
+  CHECK(relay->dropped_updates == 1);
+  CHECK(relay->probes > 0);
+  CHECK(relay->silly_updates == 0);
+  return 0;
+}
+
+/*
+ * ce: requests and responses, with the client on DCTCP so that its data
+ * is ECN capable. The relay marks client data segments CE_FIRST to
+ * CE_LAST. The server must echo the marks with ECE, on its responses
+ * too, and stop once unmarked data arrives again.
+ */
+#define CE_FIRST 20
+#define CE_LAST 39
+
+static int
+dctcp (microtcp_sock_t *sock)
+{
+  return microtcp_setsockopt (sock, MICROTCP_SO_CONGESTION, "dctcp", strlen ("dctcp"));
+}
+
+static int
+rpc_call (microtcp_sock_t *sock)
+{
+  uint8_t buffer[TEST_RPC_LEN];
+  size_t count, got, i;
+  ssize_t received;
+
+  for (count = 0; count < TEST_RPC_COUNT; count++) {
+    for (i = 0; i < TEST_RPC_LEN; i++)
+      buffer[i] = test_pattern (count * TEST_RPC_LEN + i);
+    if (microtcp_send (sock, buffer, TEST_RPC_LEN, 0) != TEST_RPC_LEN) {
+      LOG_ERROR("Failed to send request %zu", count);
+      return -1;
+    }
+    for (got = 0; got < TEST_RPC_LEN; got += received) {
+      received = microtcp_recv (sock, buffer + got, TEST_RPC_LEN - got, 0);
+      if (received <= 0) {
+        LOG_ERROR("No response to request %zu", count);
+        return -1;
+      }
+    }
+    for (i = 0; i < TEST_RPC_LEN; i++) {
+      if (buffer[i] != test_pattern (count * TEST_RPC_LEN + i)) {
+        LOG_ERROR("Byte %zu of response %zu is corrupted", i, count);
+        return -1;
+      }
+    }
+  }
+  return 0;
+}
+
+static relay_verdict_t
+ce_filter (relay_t *relay, relay_packet_t *packet)
+{
+  int ece = control_bit (&packet->header, ECE_F);
+
+  if (packet->from_client) {
+    if (packet->header.data_len == 0 || (packet->tos & IPTOS_ECN_MASK) != IPTOS_ECN_ECT0)
+      return RELAY_FORWARD;
+    relay->ect_segments++;
+    if (!packet->retransmission
+        && relay->data_segments >= CE_FIRST && relay->data_segments <= CE_LAST) {
+      packet->tos |= IPTOS_ECN_CE;
+      relay->ce_marked++;
+    }
+    return RELAY_FORWARD;
+  }
+
+  relay->server_last_ece = ece;
+  if (!ece)
+    return RELAY_FORWARD;
+  relay->server_ece++;
+  if (packet->header.data_len > 0)
+    relay->server_ece_data++;
+  if (relay->ce_marked == 0)
+    relay->server_ece_unmarked++;
+  return RELAY_FORWARD;
+}
+
+static int
+ce_check (const microtcp_sock_t *sock, const relay_t *relay)
+{
+  LOG_INFO("%zu of %zu ECN capable segments marked, %zu ECE, %zu of them on data",
+           relay->ce_marked, relay->ect_segments, relay->server_ece, relay->server_ece_data);
+  CHECK(relay->ect_segments == relay->data_segments + relay->retransmissions);
+  CHECK(relay->ce_marked == CE_LAST - CE_FIRST + 1);
+  CHECK(relay->server_ece_unmarked == 0);
+  CHECK(relay->server_ece > 0);
+  CHECK(relay->server_ece_data > 0);
+  CHECK(!relay->server_last_ece);
+  return 0;
+}
+
+typedef struct
+{
+  const char *name;
+  int (*setup) (microtcp_sock_t *sock); /* Before the connection, may be NULL */
+  int (*run) (microtcp_sock_t *sock);
+  relay_verdict_t (*filter) (relay_t *relay, relay_packet_t *packet); /* May be NULL */
+  int (*check) (const microtcp_sock_t *sock, const relay_t *relay);
+} client_test_t;
+
+static const client_test_t tests[] = {
+  { "tail_loss", NULL, tail_loss_send, tail_loss_filter, tail_loss_check },
+  { "reorder", NULL, bulk_send, reorder_filter, reorder_check },
+  { "control_loss", NULL, flush_send, control_loss_filter, control_loss_check },
+  { "small_writes", NULL, small_writes_send, NULL, small_writes_check },
+  { "delack", NULL, bulk_send, NULL, delack_check },
+  { "nodelack", NULL, bulk_send, NULL, nodelack_check },
+  { "ce", dctcp, rpc_call, ce_filter, ce_check },
+  { "persist", NULL, short_send, persist_filter, persist_check },
+};
 
 int
-main(int argc, char **argv)
+main (int argc, char **argv)
 {
+  const client_test_t *test = NULL;
+  microtcp_sock_t sock;
+  struct sockaddr_in sin;
+  relay_t *relay;
+  uint16_t port;
+  pid_t relay_pid;
+  size_t i;
+  int ret;
+
+  if (argc != 3) {
+    fprintf (stderr, "Usage: %s <port> <test>\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  for (i = 0; i < sizeof(tests) / sizeof(tests[0]); i++)
+    if (strcmp (tests[i].name, argv[2]) == 0)
+      test = &tests[i];
+  if (!test) {
+    LOG_ERROR("Unknown test %s", argv[2]);
+    return EXIT_FAILURE;
+  }
+  alarm (TEST_TIMEOUT_S);
+  port = atoi (argv[1]);
+
+  relay = mmap (NULL, sizeof(relay_t), PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (relay == MAP_FAILED) {
+    perror ("mmap");
+    return EXIT_FAILURE;
+  }
+  memset (relay, 0, sizeof(relay_t));
+  relay_pid = relay_start (relay, port + 1, port, test->filter);
+  if (relay_pid < 0)
+    return EXIT_FAILURE;
+
+  sock = microtcp_socket (AF_INET, 0, 0);
+  if (sock.state == INVALID) {
+    LOG_ERROR("Failed to create the socket");
+    return EXIT_FAILURE;
+  }
+  if (test->setup && test->setup (&sock) < 0) {
+    LOG_ERROR("Failed to set the socket up");
+    return EXIT_FAILURE;
+  }
+
+  memset (&sin, 0, sizeof(struct sockaddr_in));
+  sin.sin_family = AF_INET;
+  sin.sin_port = htons (port + 1);
+  sin.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+  if (microtcp_connect (&sock, (struct sockaddr *) &sin, sizeof(struct sockaddr_in)) < 0
+      || sock.state != ESTABLISHED) {
+    LOG_ERROR("Failed to connect");
+    kill (relay_pid, SIGTERM);
+    return EXIT_FAILURE;
+  }
+
+  ret = test->run (&sock);
+  microtcp_shutdown (&sock, SHUT_RDWR);
+  usleep (RELAY_LINGER_US);
+  kill (relay_pid, SIGTERM);
+  waitpid (relay_pid, NULL, 0);
 
+  if (ret < 0 || sock.state != CLOSED || test->check (&sock, relay) < 0) {
+    LOG_ERROR("Client side of test %s failed", test->name);
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
 }
@@ -19,12 +19,252 @@
  */
 
 /*
- * You can use this file to write a test microTCP server.
- * This file is already inserted at the build system.
+ * The server side of the microTCP client/server tests.
+ *
+ * Usage: test_microtcp_server <port> <test>
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <netinet/in.h>
+
+#include "../lib/microtcp.h"
+#include "log.h"
+#include "test_microtcp.h"
+
+/*
+ * Reads the stream until the client shuts the connection down and checks
+ * it against test_pattern(), the first start bytes being read already.
+ * Returns 0 if exactly expected_len bytes arrived intact, -1 otherwise
+ */
+static int
+receive_pattern (microtcp_sock_t *sock, size_t start, size_t expected_len)
+{
+  uint8_t buffer[4096];
+  size_t total = start;
+  ssize_t received;
+  ssize_t i;
+
+  while ((received = microtcp_recv (sock, buffer, sizeof(buffer), 0)) > 0) {
+    for (i = 0; i < received; i++) {
+      if (buffer[i] != test_pattern (total + i)) {
+        LOG_ERROR("Byte %zu of the stream is corrupted", total + i);
+        return -1;
+      }
+    }
+    total += received;
+  }
+  if (received < 0 || total != expected_len) {
+    LOG_ERROR("Received %zu bytes, expected %zu", total, expected_len);
+    return -1;
+  }
+  return 0;
+}
+
+/*
+ * A window of many segments, so that data keeps flowing while one of them
+ * is held back by the relay
+ */
+static int
+large_window (microtcp_sock_t *sock)
+{
+  size_t rcvbuf = 65536;
+
+  return microtcp_setsockopt (sock, MICROTCP_SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+}
+
+/* Delayed ACKs, each covering two segments, is the default */
+static int
+no_delack (microtcp_sock_t *sock)
+{
+  size_t ack_freq = 1;
+
+  if (large_window (sock) < 0)
+    return -1;
+  return microtcp_setsockopt (sock, MICROTCP_SO_ACK_FREQ, &ack_freq, sizeof(ack_freq));
+}
+
+static int
+tail_loss_receive (microtcp_sock_t *sock)
+{
+  return receive_pattern (sock, 0, TEST_TAIL_LEN);
+}
+
+static int
+bulk_receive (microtcp_sock_t *sock)
+{
+  return receive_pattern (sock, 0, TEST_BULK_LEN);
+}
+
+static int
+short_receive (microtcp_sock_t *sock)
+{
+  return receive_pattern (sock, 0, TEST_SHORT_LEN);
+}
+
+/* The smallest receive buffer, whose window a stalled reader closes */
+static int
+tiny_window (microtcp_sock_t *sock)
+{
+  size_t rcvbuf = MICROTCP_MIN_RECVBUF_LEN;
+
+  return microtcp_setsockopt (sock, MICROTCP_SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+}
+
+/* Keeps the connection running for us without reading anything */
+static int
+stall (microtcp_sock_t *sock, uint64_t us)
+{
+  struct timespec start, now;
+
+  clock_gettime (CLOCK_MONOTONIC, &start);
+  do {
+    if (microtcp_flush (sock, 0) < 0)
+      return -1;
+    usleep (1000);
+    clock_gettime (CLOCK_MONOTONIC, &now);
+  } while ((uint64_t) (now.tv_sec - start.tv_sec) * 1000000
+           + now.tv_nsec / 1000 - start.tv_nsec / 1000 < us);
+  return 0;
+}
+
+/*
+ * A reader that stalls with its window closed, reads a single byte,
+ * too little to open the window again, stalls once more and then reads
+ * everything
  */
+static int
+persist_receive (microtcp_sock_t *sock)
+{
+  uint8_t byte;
+
+  if (stall (sock, 300000) < 0)
+    return -1;
+  if (microtcp_recv (sock, &byte, 1, 0) != 1 || byte != test_pattern (0)) {
+    LOG_ERROR("Failed to read the first byte");
+    return -1;
+  }
+  if (stall (sock, 300000) < 0)
+    return -1;
+  return receive_pattern (sock, 1, TEST_SHORT_LEN);
+}
+
+/*
+ * Answers each request with the same bytes. Returns 0 if exactly
+ * TEST_RPC_COUNT requests arrived intact, -1 otherwise
+ */
+static int
+rpc_serve (microtcp_sock_t *sock)
+{
+  uint8_t request[TEST_RPC_LEN];
+  size_t count = 0;
+  size_t got;
+  ssize_t received;
+  size_t i;
+
+  for (;;) {
+    for (got = 0; got < TEST_RPC_LEN; got += received) {
+      received = microtcp_recv (sock, request + got, TEST_RPC_LEN - got, 0);
+      if (received <= 0)
+        break;
+    }
+    if (got == 0 && received == 0)
+      break;
+    if (got < TEST_RPC_LEN) {
+      LOG_ERROR("Request %zu is truncated", count);
+      return -1;
+    }
+    for (i = 0; i < TEST_RPC_LEN; i++) {
+      if (request[i] != test_pattern (count * TEST_RPC_LEN + i)) {
+        LOG_ERROR("Byte %zu of request %zu is corrupted", i, count);
+        return -1;
+      }
+    }
+    if (microtcp_send (sock, request, TEST_RPC_LEN, 0) != TEST_RPC_LEN) {
+      LOG_ERROR("Failed to answer request %zu", count);
+      return -1;
+    }
+    count++;
+  }
+  if (count != TEST_RPC_COUNT) {
+    LOG_ERROR("Answered %zu requests, expected %d", count, TEST_RPC_COUNT);
+    return -1;
+  }
+  return 0;
+}
+
+typedef struct
+{
+  const char *name;
+  int (*setup) (microtcp_sock_t *sock); /* Before the connection, may be NULL */
+  int (*run) (microtcp_sock_t *sock);
+} server_test_t;
+
+static const server_test_t tests[] = {
+  { "tail_loss", NULL, tail_loss_receive },
+  { "reorder", large_window, bulk_receive },
+  { "control_loss", NULL, short_receive },
+  { "small_writes", NULL, short_receive },
+  { "delack", large_window, bulk_receive },
+  { "nodelack", no_delack, bulk_receive },
+  { "ce", NULL, rpc_serve },
+  { "persist", tiny_window, persist_receive },
+};
 
 int
-main(int argc, char **argv)
+main (int argc, char **argv)
 {
+  const server_test_t *test = NULL;
+  microtcp_sock_t sock;
+  struct sockaddr_in sin;
+  struct sockaddr client_addr;
+  size_t i;
+  int ret;
+
+  if (argc != 3) {
+    fprintf (stderr, "Usage: %s <port> <test>\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  for (i = 0; i < sizeof(tests) / sizeof(tests[0]); i++)
+    if (strcmp (tests[i].name, argv[2]) == 0)
+      test = &tests[i];
+  if (!test) {
+    LOG_ERROR("Unknown test %s", argv[2]);
+    return EXIT_FAILURE;
+  }
+  alarm (TEST_TIMEOUT_S);
+
+  sock = microtcp_socket (AF_INET, 0, 0);
+  if (sock.state == INVALID) {
+    LOG_ERROR("Failed to create the socket");
+    return EXIT_FAILURE;
+  }
+  if (test->setup && test->setup (&sock) < 0) {
+    LOG_ERROR("Failed to set the socket up");
+    return EXIT_FAILURE;
+  }
+
+  memset (&sin, 0, sizeof(struct sockaddr_in));
+  sin.sin_family = AF_INET;
+  sin.sin_port = htons (atoi (argv[1]));
+  sin.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+  if (microtcp_bind (&sock, (struct sockaddr *) &sin, sizeof(struct sockaddr_in)) == -1) {
+    LOG_ERROR("Failed to bind");
+    return EXIT_FAILURE;
+  }
+  if (microtcp_accept (&sock, &client_addr, sizeof(client_addr)) != 0) {
+    LOG_ERROR("Failed to accept connection");
+    return EXIT_FAILURE;
+  }
 
+  ret = test->run (&sock);
+  microtcp_shutdown (&sock, SHUT_RDWR);
+  if (ret < 0 || sock.state != CLOSED) {
+    LOG_ERROR("Server side of test %s failed", test->name);
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
 }
@@ -0,0 +1,182 @@
+/*
+ * microtcp, a lightweight implementation of TCP for teaching,
+ * and academic purposes.
+ *
+ * Copyright (C) 2015-2017  Manolis Surligas <surligas@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Checks fast retransmit and fast recovery: the third duplicate ACK, the
+ * window during NewReno recovery, partial and full ACKs, and the losses
+ * the SACK scoreboard infers during recovery.
+ */
+
+#include "../lib/microtcp.c"
+#include "test_unit.h"
+
+#define ISN 1000
+#define SEGS 6
+#define PEER_WINDOW 0xffff
+
+static uint8_t pattern[SEGS * MICROTCP_MSS];
+
+/* A pure ACK of the peer that leaves the window as it was */
+static rx_segment_t
+peer_ack (uint32_t ack)
+{
+  rx_segment_t rx;
+
+  memset(&rx, 0, sizeof(rx));
+  rx.header.ack_number = ack;
+  rx.header.window = PEER_WINDOW;
+  rx.header.control = set_bit(0, ACK_F);
+  return rx;
+}
+
+/* Sends SEGS full segments with a window large enough for all of them */
+static void
+send_all (microtcp_sock_t *sock, int peer)
+{
+  sock->cwnd = SEGS * MICROTCP_MSS;
+  sock->curr_win_size = PEER_WINDOW;
+  EXPECT(sndbuf_append(sock, pattern, sizeof(pattern)) == sizeof(pattern));
+  EXPECT(fill_window(sock) == 0);
+  EXPECT(unit_drain(peer) == SEGS);
+}
+
+/* Expects that exactly one segment was sent, starting at seq */
+static void
+expect_retransmission (int peer, uint32_t seq)
+{
+  uint8_t buf[MICROTCP_MAX_SEGMENT];
+  rx_segment_t rx;
+
+  EXPECT(unit_next_segment(peer, buf, sizeof(buf), &rx) == 0 && rx.header.seq_number == seq);
+  EXPECT(unit_drain(peer) == 0);
+}
+
+static void
+test_newreno (void)
+{
+  microtcp_sock_t sock;
+  rx_segment_t rx;
+  int peer, i;
+
+  unit_connect(&sock, &peer, ISN, 1);
+  send_all(&sock, peer);
+
+  /* Two duplicates are not enough, the third one retransmits at once */
+  rx = peer_ack(ISN);
+  for(i = 0; i < MICROTCP_DUPACK_THRESH - 1; i++)
+    EXPECT(process_ack(&sock, &rx) == 0);
+  EXPECT(!sock.in_recovery && unit_drain(peer) == 0);
+  EXPECT(process_ack(&sock, &rx) == 0);
+  EXPECT(sock.in_recovery && sock.recover == ISN + SEGS * MICROTCP_MSS);
+  EXPECT(sock.ssthresh == SEGS * MICROTCP_MSS / 2);
+  /* The duplicates bring the estimated pipe down to ssthresh, and the
+     retransmission is all PRR sends for them */
+  EXPECT(sock.cwnd == sock.bytes_in_flight);
+  expect_retransmission(peer, ISN);
+
+  /* Every further duplicate lets a new segment replace the one that left */
+  EXPECT(process_ack(&sock, &rx) == 0);
+  EXPECT(sock.cwnd == sock.bytes_in_flight + MICROTCP_MSS);
+
+  /* A partial ACK resends the next hole. The data it acknowledges was
+     already credited to the duplicates */
+  rx = peer_ack(ISN + 2 * MICROTCP_MSS);
+  EXPECT(process_ack(&sock, &rx) == 0);
+  EXPECT(sock.in_recovery && sock.prr_credited == 2 * MICROTCP_MSS);
+  EXPECT(sock.cwnd == sock.bytes_in_flight + MICROTCP_MSS);
+  expect_retransmission(peer, ISN + 2 * MICROTCP_MSS);
+
+  /* The full ACK ends recovery without a burst */
+  rx = peer_ack(ISN + SEGS * MICROTCP_MSS);
+  EXPECT(process_ack(&sock, &rx) == 0);
+  EXPECT(!sock.in_recovery && sock.cwnd == MICROTCP_MSS && sock.rtx_head == NULL);
+
+  unit_close(&sock, peer);
+}
+
+static void
+test_sack_recovery (void)
+{
+  microtcp_sock_t sock;
+  rx_segment_t rx;
+  int peer;
+
+  unit_connect(&sock, &peer, ISN, 1);
+  sock.sack_permitted = 1;
+  send_all(&sock, peer);
+
+  /* The first and third segments are missing */
+  rx = peer_ack(ISN);
+  rx.sack_count = 1;
+  rx.sack[0].start = ISN + MICROTCP_MSS;
+  rx.sack[0].end = ISN + 2 * MICROTCP_MSS;
+  EXPECT(process_ack(&sock, &rx) == 0);
+  rx.sack[0].start = ISN + 3 * MICROTCP_MSS;
+  rx.sack[0].end = ISN + 4 * MICROTCP_MSS;
+  rx.sack_count = 2;
+  rx.sack[1].start = ISN + MICROTCP_MSS;
+  rx.sack[1].end = ISN + 2 * MICROTCP_MSS;
+  EXPECT(process_ack(&sock, &rx) == 0);
+  rx.sack[0].end = ISN + 6 * MICROTCP_MSS;
+  EXPECT(process_ack(&sock, &rx) == 0);
+
+  /* With three segments SACKed above it, the third one is lost as well.
+     The window is not inflated, the scoreboard keeps the flight count:
+     only the retransmission is in flight */
+  EXPECT(sock.in_recovery && sock.cwnd == sock.ssthresh);
+  expect_retransmission(peer, ISN);
+  EXPECT(sock.rtx_head->next->next->lost);
+  EXPECT(sock.bytes_in_flight == MICROTCP_MSS);
+
+  unit_close(&sock, peer);
+}
+
+static void
+test_after_timeout (void)
+{
+  microtcp_sock_t sock;
+  rx_segment_t rx;
+  int peer, i;
+
+  unit_connect(&sock, &peer, ISN, 1);
+  send_all(&sock, peer);
+  retransmission_timeout(&sock);
+
+  /* Duplicates of data sent before the timeout start no recovery */
+  rx = peer_ack(ISN);
+  for(i = 0; i < MICROTCP_DUPACK_THRESH + 1; i++)
+    EXPECT(process_ack(&sock, &rx) == 0);
+  EXPECT(!sock.in_recovery && unit_drain(peer) == 0);
+
+  unit_close(&sock, peer);
+}
+
+int
+main(int argc, char **argv)
+{
+  size_t i;
+
+  for(i = 0; i < sizeof(pattern); i++)
+    pattern[i] = i * 7 + 3;
+  test_newreno();
+  test_sack_recovery();
+  test_after_timeout();
+  return unit_report("Fast recovery");
+}
@@ -0,0 +1,122 @@
+/*
+ * microtcp, a lightweight implementation of TCP for teaching,
+ * and academic purposes.
+ *
+ * Copyright (C) 2015-2017  Manolis Surligas <surligas@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Checks the pacing engine: the rate it derives from the window, and that
+ * segments leave one pacing interval apart instead of in a burst.
+ */
+
+#include "../lib/microtcp.c"
+#include "test_unit.h"
+
+#define ISN 1000
+#define SEGS 10
+#define SRTT_US 20000
+
+static uint8_t pattern[SEGS * MICROTCP_MSS];
+
+/* The time a full segment occupies at the given rate */
+static uint64_t
+interval_of (uint64_t rate)
+{
+  return (sizeof(microtcp_header_t) + MICROTCP_MSS) * 1000000 / rate;
+}
+
+static void
+test_rate (void)
+{
+  microtcp_sock_t sock;
+  int peer;
+
+  unit_connect(&sock, &peer, ISN, 1);
+
+  /* Nothing to base a rate on before the first sample */
+  EXPECT(pacing_rate(&sock) == 0);
+
+  sock.srtt_us = SRTT_US;
+  sock.cwnd = SEGS * MICROTCP_MSS;
+  sock.ssthresh = 2 * SEGS * MICROTCP_MSS;
+  EXPECT(pacing_rate(&sock) == (uint64_t)sock.cwnd * 1000000 / SRTT_US * 2);
+  sock.ssthresh = sock.cwnd;
+  EXPECT(pacing_rate(&sock) == (uint64_t)sock.cwnd * 1000000 / SRTT_US * 12 / 10);
+  unit_close(&sock, peer);
+}
+
+static void
+test_spacing (void)
+{
+  microtcp_sock_t sock;
+  uint64_t interval, start, prev;
+  int peer, sent;
+
+  unit_connect(&sock, &peer, ISN, 1);
+  sock.srtt_us = SRTT_US;
+  sock.cwnd = SEGS * MICROTCP_MSS;
+  sock.ssthresh = 2 * SEGS * MICROTCP_MSS;
+  sock.curr_win_size = 0xffff;
+  interval = interval_of(pacing_rate(&sock));
+  EXPECT(interval > 2 * MICROTCP_CLOCK_GRANULARITY_US);
+
+  /* The first segment goes at once, the next one waits on the timer */
+  start = now_us();
+  EXPECT(sndbuf_append(&sock, pattern, sizeof(pattern)) == sizeof(pattern));
+  EXPECT(fill_window(&sock) == 0);
+  EXPECT(unit_drain(peer) == 1 && sock.seq_number == ISN + MICROTCP_MSS);
+  EXPECT(sock.pacing_timer_us != 0 && next_timer(&sock) == sock.pacing_timer_us);
+  EXPECT(sock.pacing_timer_us - start >= interval);
+
+  /* Each time the timer fires one more segment leaves, an interval after
+     the previous one */
+  for(sent = 1; sent < SEGS; sent++){
+    prev = sock.pacing_next_us;
+    while(now_us() + MICROTCP_CLOCK_GRANULARITY_US < sock.pacing_timer_us)
+      ;
+    EXPECT(fill_window(&sock) == 0);
+    EXPECT(unit_drain(peer) == 1);
+    EXPECT(sock.pacing_next_us - prev >= interval);
+  }
+  EXPECT(!sock.unsent_head && sock.pacing_timer_us == 0);
+  unit_close(&sock, peer);
+
+  /* Idle time earns no credit: after a pause the segments are spread
+     again instead of leaving at once */
+  unit_connect(&sock, &peer, ISN, 1);
+  sock.srtt_us = SRTT_US;
+  sock.cwnd = SEGS * MICROTCP_MSS;
+  sock.ssthresh = 2 * SEGS * MICROTCP_MSS;
+  sock.curr_win_size = 0xffff;
+  sock.pacing_next_us = now_us() - 100 * interval;
+  EXPECT(sndbuf_append(&sock, pattern, sizeof(pattern)) == sizeof(pattern));
+  EXPECT(fill_window(&sock) == 0);
+  EXPECT(unit_drain(peer) == 1);
+  unit_close(&sock, peer);
+}
+
+int
+main(int argc, char **argv)
+{
+  size_t i;
+
+  for(i = 0; i < sizeof(pattern); i++)
+    pattern[i] = i * 7 + 3;
+  test_rate();
+  test_spacing();
+  return unit_report("Pacing");
+}
@@ -0,0 +1,137 @@
+/*
+ * microtcp, a lightweight implementation of TCP for teaching,
+ * and academic purposes.
+ *
+ * Copyright (C) 2015-2017  Manolis Surligas <surligas@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Checks the persist timer: the backoff of the window probes, which
+ * stops at the largest RTO without overflowing, and the limit on probes
+ * to a peer that stopped answering.
+ */
+
+#include "../lib/microtcp.c"
+#include "test_unit.h"
+
+#define ISN 1000
+
+static uint8_t pattern[MICROTCP_MSS];
+
+static rx_segment_t
+peer_ack (uint32_t ack, uint16_t window)
+{
+  rx_segment_t rx;
+
+  memset(&rx, 0, sizeof(rx));
+  rx.header.ack_number = ack;
+  rx.header.window = window;
+  rx.header.control = set_bit(0, ACK_F);
+  return rx;
+}
+
+/* Arms the timer and returns the interval it was armed for */
+static uint64_t
+arm (microtcp_sock_t *sock)
+{
+  uint64_t before = now_us();
+
+  sock->persist_timer_us = 0;
+  persist_arm(sock);
+  return sock->persist_timer_us - before;
+}
+
+static void
+test_backoff (void)
+{
+  microtcp_sock_t sock = microtcp_socket(AF_INET, 0, 0);
+  uint64_t interval;
+  int i;
+
+  /* The interval doubles up to the largest RTO and stays there */
+  sock.rto_us = 1000000;
+  sock.rto_max_us = 8000000;
+  for(i = 0; i <= 3; i++){
+    interval = arm(&sock);
+    EXPECT(interval >= sock.rto_us << i && interval < (sock.rto_us << i) + 100000);
+  }
+  for(i = 0; i < 100; i++){
+    interval = arm(&sock);
+    EXPECT(interval >= sock.rto_max_us && interval < sock.rto_max_us + 100000);
+  }
+  EXPECT(sock.persist_backoff == 4);
+
+  /* A backoff past the width of the interval does not shift it */
+  sock.persist_backoff = 200;
+  interval = arm(&sock);
+  EXPECT(interval >= sock.rto_max_us && interval < sock.rto_max_us + 100000);
+  EXPECT(sock.persist_backoff == 200);
+
+  /* Nor does the deadline wrap around */
+  sock.rto_us = UINT64_MAX / 2;
+  sock.rto_max_us = UINT64_MAX;
+  sock.persist_backoff = 1;
+  sock.persist_timer_us = 0;
+  persist_arm(&sock);
+  EXPECT(sock.persist_timer_us == UINT64_MAX);
+  close(sock.sd);
+}
+
+/* Sends the probe of an expired persist timer */
+static int
+probe (microtcp_sock_t *sock)
+{
+  sock->persist_timer_us = now_us();
+  return on_timer(sock);
+}
+
+static void
+test_give_up (void)
+{
+  microtcp_sock_t sock;
+  rx_segment_t rx;
+  int peer, i;
+
+  unit_connect(&sock, &peer, ISN, 1);
+  sock.curr_win_size = 0;
+  EXPECT(microtcp_send(&sock, pattern, sizeof(pattern), 0) == sizeof(pattern));
+  EXPECT(sock.persist_timer_us != 0 && sock.bytes_in_flight == 0);
+  EXPECT(unit_drain(peer) == 0);
+
+  /* A peer that answers, even with a closed window, is alive */
+  for(i = 0; i < MICROTCP_DATA_RETRIES; i++)
+    EXPECT(probe(&sock) == 0);
+  rx = peer_ack(ISN, 0);
+  EXPECT(process_ack(&sock, &rx) == 0 && sock.persist_probes == 0);
+  EXPECT(unit_drain(peer) == MICROTCP_DATA_RETRIES);
+
+  /* One that answers none of the probes is given up */
+  for(i = 0; i < MICROTCP_DATA_RETRIES; i++)
+    EXPECT(probe(&sock) == 0);
+  errno = 0;
+  EXPECT(probe(&sock) < 0 && errno == ETIMEDOUT);
+  EXPECT(sock.state == INVALID && !sock.rtx_head);
+  EXPECT(unit_drain(peer) == MICROTCP_DATA_RETRIES);
+  unit_close(&sock, peer);
+}
+
+int
+main(int argc, char **argv)
+{
+  test_backoff();
+  test_give_up();
+  return unit_report("persist");
+}
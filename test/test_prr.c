@@ -0,0 +1,109 @@
+/*
+ * microtcp, a lightweight implementation of TCP for teaching,
+ * and academic purposes.
+ *
+ * Copyright (C) 2015-2017  Manolis Surligas <surligas@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Checks that proportional rate reduction spreads the sending of a fast
+ * recovery over the ACKs that arrive, and ends it with cwnd at ssthresh.
+ */
+
+#include "../lib/microtcp.c"
+#include "test_unit.h"
+
+#define ISN 1000
+#define SEGS 10
+#define PEER_WINDOW 0xffff
+
+static uint8_t pattern[2 * SEGS * MICROTCP_MSS];
+
+/* New segments sent on each ACK after the one that starts recovery */
+static const int expected_sent[SEGS - MICROTCP_DUPACK_THRESH - 1] = { 0, 0, 1, 1, 1, 1 };
+
+/* An ACK of the peer for ISN that SACKs segments 1 to last */
+static rx_segment_t
+sack_up_to (int last)
+{
+  rx_segment_t rx;
+
+  memset(&rx, 0, sizeof(rx));
+  rx.header.ack_number = ISN;
+  rx.header.window = PEER_WINDOW;
+  rx.header.control = set_bit(0, ACK_F);
+  rx.sack[0].start = ISN + MICROTCP_MSS;
+  rx.sack[0].end = ISN + (last + 1) * MICROTCP_MSS;
+  rx.sack_count = 1;
+  return rx;
+}
+
+int
+main(int argc, char **argv)
+{
+  microtcp_sock_t sock;
+  rx_segment_t rx;
+  int peer, last, sent, sent_total = 0;
+
+  unit_connect(&sock, &peer, ISN, 1);
+  unit_unpaced(&sock);
+  sock.sack_permitted = 1;
+  /* A long RTT keeps RACK from taking the first hole for lost before
+     three segments above it are SACKed */
+  sock.srtt_us = 1000000;
+  sock.min_rtt_us = 1000000;
+  sock.cwnd = SEGS * MICROTCP_MSS;
+  sock.curr_win_size = PEER_WINDOW;
+  EXPECT(sndbuf_append(&sock, pattern, sizeof(pattern)) == sizeof(pattern));
+  EXPECT(fill_window(&sock) == 0);
+  EXPECT(unit_drain(peer) == SEGS);
+
+  /* The first segment is lost, the others are SACKed one per ACK. The
+     third duplicate ACK retransmits it and nothing else */
+  for(last = 1; last <= MICROTCP_DUPACK_THRESH; last++){
+    rx = sack_up_to(last);
+    EXPECT(process_ack(&sock, &rx) == 0);
+  }
+  EXPECT(sock.in_recovery);
+  EXPECT(sock.ssthresh == SEGS * MICROTCP_MSS / 2 && sock.recover_fs == SEGS * MICROTCP_MSS);
+  EXPECT(unit_drain(peer) == 1);
+  EXPECT(sock.cwnd == sock.bytes_in_flight);
+
+  /* ssthresh / RecoverFS is one half: the first two ACKs deliver two
+     segments, and allow one, which the fast retransmit already used. By
+     then the pipe is down to ssthresh, and each further ACK replaces the
+     segment it delivered. The pipe never drops below ssthresh */
+  for(; last < SEGS; last++){
+    rx = sack_up_to(last);
+    EXPECT(process_ack(&sock, &rx) == 0);
+    EXPECT(fill_window(&sock) == 0);
+    sent = unit_drain(peer);
+    EXPECT(sent == expected_sent[last - MICROTCP_DUPACK_THRESH - 1]);
+    EXPECT(sock.bytes_in_flight >= sock.ssthresh);
+    sent_total += sent;
+  }
+
+  /* The full ACK ends recovery at ssthresh */
+  rx = sack_up_to(SEGS - 1);
+  rx.header.ack_number = ISN + SEGS * MICROTCP_MSS;
+  rx.sack_count = 0;
+  EXPECT(process_ack(&sock, &rx) == 0);
+  EXPECT(!sock.in_recovery && sock.cwnd == sock.ssthresh);
+  EXPECT(sock.bytes_in_flight == (size_t)sent_total * MICROTCP_MSS);
+
+  unit_close(&sock, peer);
+  return unit_report("PRR");
+}
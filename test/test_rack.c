@@ -0,0 +1,180 @@
+/*
+ * microtcp, a lightweight implementation of TCP for teaching,
+ * and academic purposes.
+ *
+ * Copyright (C) 2015-2017  Manolis Surligas <surligas@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Checks RACK loss detection by time, the reordering window it allows,
+ * and the arming and sending of tail loss probes.
+ */
+
+#include "../lib/microtcp.c"
+#include "test_unit.h"
+
+#define ISN 1000
+#define SEGS 4
+
+static uint8_t pattern[(SEGS + 1) * MICROTCP_MSS];
+
+/* Sends SEGS segments, then backdates them: segment i was sent ago[i]
+   microseconds before now */
+static void
+send_backdated (microtcp_sock_t *sock, int peer, const uint64_t *ago, uint64_t now)
+{
+  microtcp_segment_t *seg;
+  int i = 0;
+
+  sock->cwnd = SEGS * MICROTCP_MSS;
+  EXPECT(sndbuf_append(sock, pattern, SEGS * MICROTCP_MSS) == SEGS * MICROTCP_MSS);
+  EXPECT(fill_window(sock) == 0);
+  EXPECT(unit_drain(peer) == SEGS);
+  for(seg = sock->rtx_head; seg; seg = seg->next)
+    seg->sent_us = now - ago[i++];
+}
+
+static microtcp_segment_t *
+segment (microtcp_sock_t *sock, int k)
+{
+  microtcp_segment_t *seg = sock->rtx_head;
+
+  while(k--)
+    seg = seg->next;
+  return seg;
+}
+
+static void
+test_reo_wnd (void)
+{
+  microtcp_sock_t sock;
+  int peer;
+
+  unit_connect(&sock, &peer, ISN, 1);
+  unit_unpaced(&sock);
+  sock.sack_permitted = 1;
+  sock.min_rtt_us = 8000;
+  sock.srtt_us = 10000;
+
+  /* A quarter of the min RTT, until recovery starts */
+  EXPECT(rack_reo_wnd(&sock) == 2000);
+  sock.in_recovery = 1;
+  EXPECT(rack_reo_wnd(&sock) == 0);
+
+  /* Once the path reorders, the window holds during recovery too */
+  sock.rack_reordering_seen = 1;
+  EXPECT(rack_reo_wnd(&sock) == 2000);
+
+  /* It never exceeds the SRTT */
+  sock.srtt_us = 1000;
+  EXPECT(rack_reo_wnd(&sock) == 1000);
+  unit_close(&sock, peer);
+}
+
+static void
+test_detect_loss (void)
+{
+  const uint64_t ago[SEGS] = { 5000, 1100, 1000, 900 };
+  microtcp_sock_t sock;
+  uint64_t now = now_us();
+  int peer;
+
+  unit_connect(&sock, &peer, ISN, 1);
+  unit_unpaced(&sock);
+  sock.sack_permitted = 1;
+  sock.min_rtt_us = 800;
+  sock.srtt_us = 1000;
+  send_backdated(&sock, peer, ago, now);
+
+  /* The third segment is delivered after 1000 us. The first was sent
+     long before it and is lost. The second is only 100 us older, inside
+     the 200 us reordering window: it turns lost once 1000 + 200 us have
+     passed since it was sent, 100 us from now */
+  rack_update(&sock, segment(&sock, 2), now);
+  segment(&sock, 2)->sacked = 1;
+  EXPECT(sock.rack_rtt_us == 1000 && sock.rack_fack == ISN + 3 * MICROTCP_MSS);
+  EXPECT(rack_detect_loss(&sock, now) == 1);
+  EXPECT(segment(&sock, 0)->lost && !segment(&sock, 1)->lost && !segment(&sock, 3)->lost);
+  EXPECT(sock.rack_timer_us == now + 100);
+  EXPECT(rack_detect_loss(&sock, now + 100) == 1 && segment(&sock, 1)->lost);
+  EXPECT(sock.rack_timer_us == 0);
+
+  /* Data never retransmitted, delivered below the highest delivered
+     sequence number, shows reordering. A retransmission does not */
+  EXPECT(!sock.rack_reordering_seen);
+  segment(&sock, 0)->retransmissions = 1;
+  rack_update(&sock, segment(&sock, 0), now);
+  EXPECT(!sock.rack_reordering_seen);
+  rack_update(&sock, segment(&sock, 1), now);
+  EXPECT(sock.rack_reordering_seen);
+  unit_close(&sock, peer);
+}
+
+static void
+test_tail_loss_probe (void)
+{
+  const uint64_t ago[SEGS] = { 0, 0, 0, 0 };
+  microtcp_sock_t sock;
+  uint8_t buf[MICROTCP_MAX_SEGMENT];
+  rx_segment_t rx;
+  uint64_t now = now_us();
+  int peer;
+
+  unit_connect(&sock, &peer, ISN, 1);
+  unit_unpaced(&sock);
+  sock.sack_permitted = 1;
+  sock.srtt_us = 1000;
+  sock.rto_us = 200000;
+  send_backdated(&sock, peer, ago, now);
+
+  /* Two SRTTs after the last transmission, well before the RTO */
+  tlp_arm(&sock);
+  EXPECT(sock.tlp_timer_us >= now + 2000 && sock.tlp_timer_us <= now_us() + 2000 + 1000);
+  sock.rtx_timer_us = now + 1000;
+  tlp_arm(&sock);
+  EXPECT(sock.tlp_timer_us == now + 1000);
+  sock.in_recovery = 1;
+  tlp_arm(&sock);
+  EXPECT(sock.tlp_timer_us == 0);
+  sock.in_recovery = 0;
+
+  /* The probe carries new data while the window allows */
+  EXPECT(sndbuf_append(&sock, pattern + SEGS * MICROTCP_MSS, sizeof(pattern) - SEGS * MICROTCP_MSS)
+         == sizeof(pattern) - SEGS * MICROTCP_MSS);
+  EXPECT(tlp_send_probe(&sock) == 0);
+  EXPECT(unit_next_segment(peer, buf, sizeof(buf), &rx) == 0
+         && rx.header.seq_number == ISN + SEGS * MICROTCP_MSS);
+  EXPECT(sock.tlp_active && !sock.tlp_retrans && !sock.unsent_head);
+
+  /* Without any, it resends the last segment not SACKed */
+  sock.rtx_tail->sacked = 1;
+  sock.bytes_in_flight -= sock.rtx_tail->data_len;
+  EXPECT(tlp_send_probe(&sock) == 0);
+  EXPECT(unit_next_segment(peer, buf, sizeof(buf), &rx) == 0
+         && rx.header.seq_number == ISN + (SEGS - 1) * MICROTCP_MSS);
+  EXPECT(sock.tlp_retrans && segment(&sock, SEGS - 1)->retransmissions == 1);
+  EXPECT(sock.bytes_in_flight == SEGS * MICROTCP_MSS);
+  unit_close(&sock, peer);
+}
+
+int
+main(int argc, char **argv)
+{
+  test_reo_wnd();
+  test_detect_loss();
+  test_tail_loss_probe();
+  return unit_report("RACK");
+}
@@ -0,0 +1,154 @@
+/*
+ * microtcp, a lightweight implementation of TCP for teaching,
+ * and academic purposes.
+ *
+ * Copyright (C) 2015-2017  Manolis Surligas <surligas@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Checks receive buffer auto-tuning: the ring grows with what the
+ * application reads per receiver RTT, keeps the data it holds when it
+ * moves, and shrinks back once the connection is idle.
+ */
+
+#include "../lib/microtcp.c"
+#include "test_unit.h"
+
+#define ISN 1000
+#define CHUNK 1024
+#define RCV_RTT_US 1000
+
+static uint8_t pattern[4 * MICROTCP_RECVBUF_LEN];
+
+/* Receives len bytes of the pattern at stream offset off */
+static void
+receive (microtcp_sock_t *sock, size_t off, size_t len)
+{
+  size_t n;
+
+  for(; len > 0; off += n, len -= n){
+    n = len < CHUNK ? len : CHUNK;
+    reassemble(sock, ISN + off, pattern + off, n);
+  }
+}
+
+/* Reads len bytes and checks they are the pattern at stream offset off */
+static void
+expect_read (microtcp_sock_t *sock, size_t off, size_t len)
+{
+  static uint8_t buf[sizeof(pattern)];
+
+  EXPECT(recvbuf_read(sock, buf, len) == len);
+  EXPECT(memcmp(buf, pattern + off, len) == 0);
+}
+
+/* Lets one receiver RTT pass and runs auto-tuning */
+static void
+next_round (microtcp_sock_t *sock)
+{
+  usleep(2 * RCV_RTT_US);
+  recvbuf_autotune(sock);
+}
+
+static void
+test_grow (void)
+{
+  microtcp_sock_t sock;
+  int peer;
+
+  unit_connect(&sock, &peer, 1, ISN);
+  sock.rcv_rtt_us = RCV_RTT_US;
+  recvbuf_autotune(&sock);
+
+  /* A round in which the application read a whole ring doubles it.
+     Unread and out-of-order data move along */
+  receive(&sock, 0, MICROTCP_RECVBUF_LEN);
+  expect_read(&sock, 0, MICROTCP_RECVBUF_LEN);
+  receive(&sock, MICROTCP_RECVBUF_LEN, CHUNK);
+  receive(&sock, MICROTCP_RECVBUF_LEN + 3 * CHUNK, CHUNK);
+  next_round(&sock);
+  EXPECT(sock.recvbuf_len == 2 * MICROTCP_RECVBUF_LEN);
+  receive(&sock, MICROTCP_RECVBUF_LEN + CHUNK, 2 * CHUNK);
+  EXPECT(sock.ack_number == ISN + MICROTCP_RECVBUF_LEN + 4 * CHUNK);
+  expect_read(&sock, MICROTCP_RECVBUF_LEN, 4 * CHUNK);
+
+  /* A round with little read leaves it alone */
+  next_round(&sock);
+  EXPECT(sock.recvbuf_len == 2 * MICROTCP_RECVBUF_LEN);
+
+  /* Neither does one past the memory budget of the process */
+  receive(&sock, MICROTCP_RECVBUF_LEN + 4 * CHUNK, 2 * MICROTCP_RECVBUF_LEN);
+  expect_read(&sock, MICROTCP_RECVBUF_LEN + 4 * CHUNK, 2 * MICROTCP_RECVBUF_LEN);
+  atomic_fetch_add(&recvbuf_mem, MICROTCP_RCVBUF_MEM_MAX);
+  next_round(&sock);
+  atomic_fetch_sub(&recvbuf_mem, MICROTCP_RCVBUF_MEM_MAX);
+  EXPECT(sock.recvbuf_len == 2 * MICROTCP_RECVBUF_LEN);
+  unit_close(&sock, peer);
+
+  /* A fixed size turns auto-tuning off */
+  unit_connect(&sock, &peer, 1, ISN);
+  sock.rcvbuf_auto = 0;
+  sock.rcv_rtt_us = RCV_RTT_US;
+  recvbuf_autotune(&sock);
+  receive(&sock, 0, MICROTCP_RECVBUF_LEN);
+  expect_read(&sock, 0, MICROTCP_RECVBUF_LEN);
+  next_round(&sock);
+  EXPECT(sock.recvbuf_len == MICROTCP_RECVBUF_LEN);
+  unit_close(&sock, peer);
+}
+
+static void
+test_shrink (void)
+{
+  microtcp_sock_t sock;
+  uint8_t buf[MICROTCP_MAX_SEGMENT];
+  rx_segment_t ack;
+  int peer;
+
+  unit_connect(&sock, &peer, 1, ISN);
+  EXPECT(recvbuf_resize(&sock, 4 * MICROTCP_RECVBUF_LEN) == 0);
+
+  /* Not while it holds data */
+  receive(&sock, 0, CHUNK);
+  EXPECT(recvbuf_idle_deadline(&sock) == 0);
+  expect_read(&sock, 0, CHUNK);
+  EXPECT(recvbuf_idle_deadline(&sock) == sock.rcv_last_us + MICROTCP_RCVBUF_IDLE_US);
+
+  /* Nor before the connection was idle long enough */
+  EXPECT(recvbuf_idle(&sock) == 0);
+  EXPECT(sock.recvbuf_len == 4 * MICROTCP_RECVBUF_LEN && unit_drain(peer) == 0);
+
+  /* Then it shrinks back to the default and tells the peer */
+  sock.rcv_last_us -= MICROTCP_RCVBUF_IDLE_US;
+  EXPECT(recvbuf_idle(&sock) == 0);
+  EXPECT(sock.recvbuf_len == MICROTCP_RECVBUF_LEN);
+  EXPECT(unit_next_segment(peer, buf, sizeof(buf), &ack) == 0);
+  EXPECT(ack.header.window == MICROTCP_RECVBUF_LEN >> sock.rcv_wscale);
+  EXPECT(recvbuf_idle_deadline(&sock) == 0);
+  unit_close(&sock, peer);
+}
+
+int
+main(int argc, char **argv)
+{
+  size_t i;
+
+  for(i = 0; i < sizeof(pattern); i++)
+    pattern[i] = i * 7 + 3;
+  test_grow();
+  test_shrink();
+  return unit_report("Receive buffer");
+}
@@ -0,0 +1,178 @@
+/*
+ * microtcp, a lightweight implementation of TCP for teaching,
+ * and academic purposes.
+ *
+ * Copyright (C) 2015-2017  Manolis Surligas <surligas@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Checks the RTO estimator of RFC 6298, its exponential backoff, Karn's
+ * rule on the samples taken from acknowledged segments and the limit on
+ * retransmissions to a peer that stopped answering.
+ */
+
+#include "../lib/microtcp.c"
+#include "test_unit.h"
+
+#define ISN 1000
+
+static uint8_t pattern[2 * MICROTCP_MSS];
+
+static rx_segment_t
+peer_ack (uint32_t ack)
+{
+  rx_segment_t rx;
+
+  memset(&rx, 0, sizeof(rx));
+  rx.header.ack_number = ack;
+  rx.header.window = MICROTCP_RECVBUF_LEN;
+  rx.header.control = set_bit(0, ACK_F);
+  return rx;
+}
+
+static void
+test_estimator (void)
+{
+  microtcp_sock_t sock = microtcp_socket(AF_INET, 0, 0);
+
+  EXPECT(sock.rto_us == MICROTCP_ACK_TIMEOUT_US);
+
+  /* The first sample sets SRTT and half of it as RTTVAR */
+  update_rtt(&sock, 100000);
+  EXPECT(sock.srtt_us == 100000 && sock.rttvar_us == 50000);
+  EXPECT(sock.rto_us == 100000 + 4 * 50000);
+
+  /* A steady RTT shrinks the variation by a quarter each time */
+  update_rtt(&sock, 100000);
+  EXPECT(sock.srtt_us == 100000 && sock.rttvar_us == 37500);
+  EXPECT(sock.rto_us == 100000 + 4 * 37500);
+
+  /* A slower sample moves SRTT by an eighth of the difference */
+  update_rtt(&sock, 180000);
+  EXPECT(sock.srtt_us == 110000 && sock.rttvar_us == (3 * 37500 + 80000) / 4);
+
+  /* The RTO stays within its bounds */
+  close(sock.sd);
+  sock = microtcp_socket(AF_INET, 0, 0);
+  update_rtt(&sock, 10);
+  EXPECT(sock.rto_us == MICROTCP_MIN_RTO_US);
+  update_rtt(&sock, 2 * (uint64_t)MICROTCP_MAX_RTO_US);
+  EXPECT(sock.rto_us == MICROTCP_MAX_RTO_US);
+  close(sock.sd);
+}
+
+static void
+test_backoff (void)
+{
+  microtcp_sock_t sock;
+  int peer, i;
+
+  unit_connect(&sock, &peer, ISN, 1);
+  for(i = 1; i <= 3; i++){
+    retransmission_timeout(&sock);
+    EXPECT(sock.rto_us == (uint64_t)MICROTCP_ACK_TIMEOUT_US << i);
+  }
+  for(; i <= MICROTCP_DATA_RETRIES; i++)
+    EXPECT(retransmission_timeout(&sock) == 0);
+  EXPECT(sock.rto_us == MICROTCP_MAX_RTO_US && sock.state == ESTABLISHED);
+  unit_close(&sock, peer);
+}
+
+static void
+test_give_up (void)
+{
+  microtcp_sock_t sock;
+  rx_segment_t rx;
+  int peer, i;
+
+  unit_connect(&sock, &peer, ISN, 1);
+  sock.rto_us = sock.rto_min_us;
+  sock.rto_max_us = 2 * sock.rto_min_us;
+
+  /* An ACK of new data starts the count again */
+  EXPECT(microtcp_send(&sock, pattern, MICROTCP_MSS, 0) == MICROTCP_MSS);
+  for(i = 0; i < MICROTCP_DATA_RETRIES; i++)
+    EXPECT(retransmission_timeout(&sock) == 0);
+  rx = peer_ack(ISN + MICROTCP_MSS);
+  EXPECT(process_ack(&sock, &rx) == 0 && sock.rtx_backoff == 0);
+  unit_drain(peer);
+
+  /* A peer that never answers: the segment is sent once and retransmitted
+     MICROTCP_DATA_RETRIES times, then the connection is given up */
+  EXPECT(microtcp_send(&sock, pattern, MICROTCP_MSS, 0) == MICROTCP_MSS);
+  errno = 0;
+  EXPECT(microtcp_flush(&sock, 10000000) < 0 && errno == ETIMEDOUT);
+  EXPECT(sock.state == INVALID && !sock.rtx_head && sock.bytes_in_flight == 0);
+  EXPECT(unit_drain(peer) == 1 + MICROTCP_DATA_RETRIES);
+
+  /* There is no FIN to exchange any more */
+  EXPECT(microtcp_send(&sock, pattern, MICROTCP_MSS, 0) < 0);
+  EXPECT(microtcp_shutdown(&sock, SHUT_RDWR) < 0 && errno == ENOTCONN);
+  EXPECT(unit_drain(peer) == 0);
+  unit_close(&sock, peer);
+}
+
+static void
+test_samples (void)
+{
+  microtcp_sock_t sock;
+  rx_segment_t rx;
+  uint64_t start;
+  int peer;
+
+  unit_connect(&sock, &peer, ISN, 1);
+
+  /* The first transmission starts the timer, with the initial RTO */
+  start = now_us();
+  EXPECT(sndbuf_append(&sock, pattern, sizeof(pattern)) == sizeof(pattern));
+  EXPECT(fill_window(&sock) == 0);
+  EXPECT(unit_drain(peer) == 2);
+  EXPECT(sock.rtx_timer_us >= start + MICROTCP_ACK_TIMEOUT_US
+         && sock.rtx_timer_us <= now_us() + MICROTCP_ACK_TIMEOUT_US);
+
+  /* Acknowledging the first segment samples its RTT and restarts the timer */
+  sock.rtx_head->sent_us -= 50000;
+  rx = peer_ack(ISN + MICROTCP_MSS);
+  EXPECT(process_ack(&sock, &rx) == 0);
+  EXPECT(sock.srtt_us >= 50000 && sock.srtt_us < 60000);
+  EXPECT(sock.rtx_timer_us > now_us() && sock.rtx_timer_us <= now_us() + sock.rto_us);
+
+  /* The retransmitted second segment gives no sample, and its ACK keeps
+     the backed off RTO */
+  retransmission_timeout(&sock);
+  EXPECT(sock.rtx_timer_us == 0);
+  EXPECT(fill_window(&sock) == 0);
+  EXPECT(unit_drain(peer) == 1 && sock.rtx_timer_us != 0);
+  sock.rtx_head->sent_us -= 900000;
+  rx = peer_ack(ISN + 2 * MICROTCP_MSS);
+  EXPECT(process_ack(&sock, &rx) == 0);
+  EXPECT(sock.srtt_us < 60000);
+  EXPECT(sock.rto_us == 2 * (sock.srtt_us + 4 * sock.rttvar_us));
+
+  /* Nothing left in flight stops the timer */
+  EXPECT(sock.rtx_head == NULL && sock.rtx_timer_us == 0);
+  unit_close(&sock, peer);
+}
+
+int
+main(int argc, char **argv)
+{
+  test_estimator();
+  test_backoff();
+  test_give_up();
+  test_samples();
+  return unit_report("RTO");
+}
@@ -0,0 +1,208 @@
+/*
+ * microtcp, a lightweight implementation of TCP for teaching,
+ * and academic purposes.
+ *
+ * Copyright (C) 2015-2017  Manolis Surligas <surligas@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Checks the SACK blocks a receiver builds for the out-of-order data it
+ * holds, and the scoreboard a sender keeps from the blocks it gets back.
+ */
+
+#include "../lib/microtcp.c"
+#include "test_unit.h"
+
+#define ISN 1000
+#define CHUNK 1000
+
+static uint8_t pattern[8 * MICROTCP_MSS];
+
+/* Receives chunk k of the pattern and reads back the ACK it triggers */
+static void
+receive_chunk (microtcp_sock_t *sock, int peer, int k, uint8_t *buf, rx_segment_t *ack)
+{
+  reassemble(sock, ISN + k * CHUNK, pattern + k * CHUNK, CHUNK);
+  EXPECT(send_ack(sock) == 0);
+  EXPECT(unit_next_segment(peer, buf, MICROTCP_MAX_SEGMENT, ack) == 0);
+}
+
+static void
+test_receiver_blocks (void)
+{
+  microtcp_sock_t sock;
+  uint8_t buf[MICROTCP_MAX_SEGMENT];
+  uint8_t data[5 * CHUNK];
+  rx_segment_t ack;
+  int peer;
+
+  unit_connect(&sock, &peer, 1, ISN);
+  sock.sack_permitted = 1;
+
+  /* Two holes, the newest range is reported first */
+  receive_chunk(&sock, peer, 2, buf, &ack);
+  receive_chunk(&sock, peer, 4, buf, &ack);
+  EXPECT(ack.header.ack_number == ISN);
+  EXPECT(ack.sack_count == 2);
+  EXPECT(ack.sack[0].start == ISN + 4 * CHUNK && ack.sack[0].end == ISN + 5 * CHUNK);
+  EXPECT(ack.sack[1].start == ISN + 2 * CHUNK && ack.sack[1].end == ISN + 3 * CHUNK);
+
+  /* The chunk between them merges both ranges */
+  receive_chunk(&sock, peer, 3, buf, &ack);
+  EXPECT(ack.sack_count == 1);
+  EXPECT(ack.sack[0].start == ISN + 2 * CHUNK && ack.sack[0].end == ISN + 5 * CHUNK);
+
+  /* Filling the first hole moves the cumulative ACK up to the second one */
+  receive_chunk(&sock, peer, 0, buf, &ack);
+  EXPECT(ack.header.ack_number == ISN + CHUNK);
+  EXPECT(ack.sack_count == 1);
+
+  /* The last hole leaves no out-of-order data to report */
+  receive_chunk(&sock, peer, 1, buf, &ack);
+  EXPECT(ack.header.ack_number == ISN + 5 * CHUNK);
+  EXPECT(ack.sack_count == 0 && ack.header.future_use0 == 0);
+  EXPECT(recvbuf_read(&sock, data, sizeof(data)) == sizeof(data));
+  EXPECT(memcmp(data, pattern, sizeof(data)) == 0);
+
+  /* Without the agreement of the handshake no block is sent */
+  sock.sack_permitted = 0;
+  receive_chunk(&sock, peer, 7, buf, &ack);
+  EXPECT(ack.header.ack_number == ISN + 5 * CHUNK && ack.sack_count == 0);
+
+  unit_close(&sock, peer);
+}
+
+static void
+test_parse (void)
+{
+  uint8_t buf[MICROTCP_MAX_SEGMENT];
+  microtcp_header_t header;
+  rx_segment_t rx;
+  uint32_t block[2] = { htonl(5), htonl(9) };
+
+  /* The option word of a SYN lists capabilities, it counts no blocks */
+  header = make_header(1, 0, MICROTCP_RECVBUF_LEN, 0, 0, 0, 1, 0);
+  header.future_use0 = htonl(MICROTCP_OPT_SACK_PERMITTED | 1);
+  memcpy(buf, &header, sizeof(header));
+  EXPECT(parse_segment(buf, sizeof(header), &rx) == 0 && rx.sack_count == 0);
+
+  header = make_header(1, 5, MICROTCP_RECVBUF_LEN, 3, 1, 0, 0, 0);
+  header.future_use0 = htonl(1);
+  memcpy(buf, &header, sizeof(header));
+  memcpy(buf + sizeof(header), block, sizeof(block));
+  memcpy(buf + sizeof(header) + sizeof(block), "abc", 3);
+  EXPECT(parse_segment(buf, sizeof(header) + sizeof(block) + 3, &rx) == 0);
+  EXPECT(rx.sack_count == 1 && rx.sack[0].start == 5 && rx.sack[0].end == 9);
+  EXPECT(memcmp(rx.data, "abc", 3) == 0);
+
+  /* Blocks or payload cut short */
+  EXPECT(parse_segment(buf, sizeof(header) + sizeof(block) + 2, &rx) < 0);
+  EXPECT(parse_segment(buf, sizeof(header) + 4, &rx) < 0);
+  header.future_use0 = htonl(MICROTCP_MAX_SACK_BLOCKS + 1);
+  memcpy(buf, &header, sizeof(header));
+  EXPECT(parse_segment(buf, sizeof(buf), &rx) < 0);
+}
+
+/* An ACK of the peer with a single SACK block */
+static rx_segment_t
+sack_ack (uint32_t ack, uint32_t start, uint32_t end)
+{
+  rx_segment_t rx;
+
+  memset(&rx, 0, sizeof(rx));
+  rx.header.ack_number = ack;
+  rx.header.window = MICROTCP_RECVBUF_LEN;
+  rx.header.control = set_bit(0, ACK_F);
+  rx.sack[0].start = start;
+  rx.sack[0].end = end;
+  rx.sack_count = 1;
+  return rx;
+}
+
+static void
+test_sender_scoreboard (void)
+{
+  microtcp_sock_t sock;
+  uint8_t buf[MICROTCP_MAX_SEGMENT];
+  rx_segment_t rx;
+  microtcp_segment_t *seg;
+  int peer;
+
+  unit_connect(&sock, &peer, ISN, 1);
+  unit_unpaced(&sock);
+  sock.sack_permitted = 1;
+  /* A long RTT keeps RACK from taking the hole for lost, only the timeout
+     below does */
+  sock.srtt_us = 1000000;
+  sock.min_rtt_us = 1000000;
+  sock.cwnd = 8 * MICROTCP_MSS;
+
+  EXPECT(sndbuf_append(&sock, pattern, 4 * MICROTCP_MSS) == 4 * MICROTCP_MSS);
+  EXPECT(fill_window(&sock) == 0);
+  EXPECT(unit_drain(peer) == 4);
+  EXPECT(sock.bytes_in_flight == 4 * MICROTCP_MSS);
+
+  /* The second and third segments arrived, the first did not */
+  rx = sack_ack(ISN, ISN + MICROTCP_MSS, ISN + 3 * MICROTCP_MSS);
+  process_ack(&sock, &rx);
+  EXPECT(sock.snd_una == ISN);
+  EXPECT(sock.bytes_in_flight == 2 * MICROTCP_MSS);
+  seg = sock.rtx_head;
+  EXPECT(!seg->sacked && seg->next->sacked && seg->next->next->sacked && !sock.rtx_tail->sacked);
+
+  /* A block past the data sent is ignored */
+  rx = sack_ack(ISN, ISN + 4 * MICROTCP_MSS, ISN + 5 * MICROTCP_MSS);
+  process_ack(&sock, &rx);
+  EXPECT(sock.bytes_in_flight == 2 * MICROTCP_MSS && !sock.rtx_tail->sacked);
+
+  /* A timeout marks lost only what the peer did not SACK. The window
+     restarts from one segment */
+  retransmission_timeout(&sock);
+  EXPECT(sock.bytes_in_flight == 0 && sock.cwnd == MICROTCP_MSS);
+  EXPECT(seg->lost && !seg->next->lost && !seg->next->next->lost && sock.rtx_tail->lost);
+  EXPECT(fill_window(&sock) == 0);
+  EXPECT(unit_next_segment(peer, buf, sizeof(buf), &rx) == 0 && rx.header.seq_number == ISN);
+  EXPECT(unit_drain(peer) == 0);
+
+  /* Its ACK covers the SACKed segments too, the last one is sent next */
+  rx = sack_ack(ISN + 3 * MICROTCP_MSS, 0, 0);
+  rx.sack_count = 0;
+  process_ack(&sock, &rx);
+  EXPECT(sock.rtx_head == sock.rtx_tail && sock.bytes_in_flight == 0);
+  EXPECT(fill_window(&sock) == 0);
+  EXPECT(unit_next_segment(peer, buf, sizeof(buf), &rx) == 0
+         && rx.header.seq_number == ISN + 3 * MICROTCP_MSS);
+
+  rx = sack_ack(ISN + 4 * MICROTCP_MSS, 0, 0);
+  rx.sack_count = 0;
+  process_ack(&sock, &rx);
+  EXPECT(sock.rtx_head == NULL && sock.bytes_in_flight == 0);
+
+  unit_close(&sock, peer);
+}
+
+int
+main(int argc, char **argv)
+{
+  size_t i;
+
+  for(i = 0; i < sizeof(pattern); i++)
+    pattern[i] = i * 7 + 3;
+  test_receiver_blocks();
+  test_parse();
+  test_sender_scoreboard();
+  return unit_report("SACK");
+}
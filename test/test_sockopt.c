@@ -0,0 +1,145 @@
+/*
+ * microtcp, a lightweight implementation of TCP for teaching,
+ * and academic purposes.
+ *
+ * Copyright (C) 2015-2017  Manolis Surligas <surligas@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Checks microtcp_setsockopt() and microtcp_getsockopt(): the values each
+ * option accepts, and what setting it changes on the socket.
+ */
+
+#include "../lib/microtcp.c"
+#include "test_unit.h"
+
+/* Sets a size_t option. Returns 0 or the errno of the failure */
+static int
+set_size (microtcp_sock_t *sock, int option, size_t size)
+{
+  return microtcp_setsockopt(sock, option, &size, sizeof(size)) == 0 ? 0 : errno;
+}
+
+/* Sets a time option. Returns 0 or the errno of the failure */
+static int
+set_us (microtcp_sock_t *sock, int option, uint64_t us)
+{
+  return microtcp_setsockopt(sock, option, &us, sizeof(us)) == 0 ? 0 : errno;
+}
+
+static void
+test_arguments (void)
+{
+  microtcp_sock_t sock = microtcp_socket(AF_INET, 0, 0);
+  size_t size = MICROTCP_MSS, len = sizeof(size);
+  uint32_t narrow = MICROTCP_MSS;
+
+  EXPECT(microtcp_setsockopt(&sock, -1, &size, sizeof(size)) < 0 && errno == ENOPROTOOPT);
+  EXPECT(microtcp_getsockopt(&sock, -1, &size, &len) < 0 && errno == ENOPROTOOPT);
+  EXPECT(microtcp_setsockopt(&sock, MICROTCP_SO_MSS, NULL, sizeof(size)) < 0 && errno == EINVAL);
+  EXPECT(microtcp_setsockopt(&sock, MICROTCP_SO_MSS, &narrow, sizeof(narrow)) < 0 && errno == EINVAL);
+  len = sizeof(narrow);
+  EXPECT(microtcp_getsockopt(&sock, MICROTCP_SO_MSS, &narrow, &len) < 0 && errno == EINVAL);
+  close(sock.sd);
+}
+
+static void
+test_sizes (void)
+{
+  microtcp_sock_t sock = microtcp_socket(AF_INET, 0, 0);
+  size_t size, len = sizeof(size);
+
+  /* The receive buffer is rounded up to a power of two */
+  EXPECT(set_size(&sock, MICROTCP_SO_RCVBUF, MICROTCP_MIN_RECVBUF_LEN - 1) == EINVAL);
+  EXPECT(set_size(&sock, MICROTCP_SO_RCVBUF, (size_t)MICROTCP_MAX_RECVBUF_LEN + 1) == EINVAL);
+  EXPECT(set_size(&sock, MICROTCP_SO_RCVBUF, 40000) == 0);
+  EXPECT(microtcp_getsockopt(&sock, MICROTCP_SO_RCVBUF, &size, &len) == 0);
+  EXPECT(len == sizeof(size) && size == 65536);
+  EXPECT(sock.ssthresh == 65536);
+
+  /* The MSS and the initial window restart the congestion window */
+  EXPECT(set_size(&sock, MICROTCP_SO_MSS, MICROTCP_MIN_MSS - 1) == EINVAL);
+  EXPECT(set_size(&sock, MICROTCP_SO_MSS, MICROTCP_MAX_MSS + 1) == EINVAL);
+  EXPECT(set_size(&sock, MICROTCP_SO_MSS, 1000) == 0);
+  EXPECT(sock.mss == 1000 && sock.cwnd == MICROTCP_INIT_CWND_SEGS * 1000);
+  EXPECT(set_size(&sock, MICROTCP_SO_INIT_CWND, 0) == EINVAL);
+  EXPECT(set_size(&sock, MICROTCP_SO_INIT_CWND, 10) == 0);
+  EXPECT(sock.cwnd == 10 * 1000);
+
+  /* Once the receive buffer exists its size is fixed */
+  EXPECT(alloc_recvbuf(&sock) == 0);
+  EXPECT(set_size(&sock, MICROTCP_SO_RCVBUF, 8192) == EISCONN);
+  EXPECT(sock.recvbuf_len == 65536);
+  free_recvbuf(&sock);
+  close(sock.sd);
+}
+
+static void
+test_congestion (void)
+{
+  microtcp_sock_t sock = microtcp_socket(AF_INET, 0, 0);
+  char name[MICROTCP_CC_NAME_MAX + 1];
+  size_t len = sizeof(name);
+
+  EXPECT(microtcp_setsockopt(&sock, MICROTCP_SO_CONGESTION, "none", 4) < 0 && errno == ENOENT);
+  EXPECT(microtcp_setsockopt(&sock, MICROTCP_SO_CONGESTION, "cubic", 0) < 0 && errno == EINVAL);
+  EXPECT(microtcp_setsockopt(&sock, MICROTCP_SO_CONGESTION, "cubic", 5) == 0);
+  EXPECT(microtcp_getsockopt(&sock, MICROTCP_SO_CONGESTION, name, &len) == 0);
+  EXPECT(len == 5 && strcmp(name, "cubic") == 0);
+  len = 3;
+  EXPECT(microtcp_getsockopt(&sock, MICROTCP_SO_CONGESTION, name, &len) < 0 && errno == EINVAL);
+  close(sock.sd);
+}
+
+static void
+test_rto (void)
+{
+  microtcp_sock_t sock = microtcp_socket(AF_INET, 0, 0);
+  uint64_t us;
+  size_t len = sizeof(us);
+
+  /* Each bound has to keep min <= init <= max */
+  EXPECT(set_us(&sock, MICROTCP_SO_RTO_MIN, 0) == EINVAL);
+  EXPECT(set_us(&sock, MICROTCP_SO_RTO_MIN, MICROTCP_ACK_TIMEOUT_US + 1) == EINVAL);
+  EXPECT(set_us(&sock, MICROTCP_SO_RTO_INIT, MICROTCP_MIN_RTO_US - 1) == EINVAL);
+  EXPECT(set_us(&sock, MICROTCP_SO_RTO_INIT, MICROTCP_MAX_RTO_US + 1) == EINVAL);
+  EXPECT(set_us(&sock, MICROTCP_SO_RTO_MAX, MICROTCP_ACK_TIMEOUT_US - 1) == EINVAL);
+
+  /* And max stays below a ceiling, so that the backoff cannot overflow */
+  EXPECT(set_us(&sock, MICROTCP_SO_RTO_MAX, MICROTCP_RTO_LIMIT_US + 1) == EINVAL);
+  EXPECT(set_us(&sock, MICROTCP_SO_RTO_MAX, UINT64_MAX) == EINVAL);
+  EXPECT(set_us(&sock, MICROTCP_SO_RTO_MAX, MICROTCP_RTO_LIMIT_US) == 0);
+  EXPECT(set_us(&sock, MICROTCP_SO_RTO_INIT, MICROTCP_RTO_LIMIT_US) == 0);
+  EXPECT(sock.rto_us == MICROTCP_RTO_LIMIT_US);
+  EXPECT(microtcp_getsockopt(&sock, MICROTCP_SO_RTO_INIT, &us, &len) == 0);
+  EXPECT(len == sizeof(us) && us == MICROTCP_RTO_LIMIT_US);
+
+  EXPECT(set_us(&sock, MICROTCP_SO_RTO_INIT, 50000) == 0);
+  EXPECT(set_us(&sock, MICROTCP_SO_RTO_MIN, 50000) == 0);
+  EXPECT(set_us(&sock, MICROTCP_SO_RTO_MAX, 50000) == 0);
+  EXPECT(sock.rto_min_us == 50000 && sock.rto_us == 50000 && sock.rto_max_us == 50000);
+  close(sock.sd);
+}
+
+int
+main(int argc, char **argv)
+{
+  test_arguments();
+  test_sizes();
+  test_congestion();
+  test_rto();
+  return unit_report("Socket option");
+}
@@ -0,0 +1,133 @@
+/*
+ * microtcp, a lightweight implementation of TCP for teaching,
+ * and academic purposes.
+ *
+ * Copyright (C) 2015-2017  Manolis Surligas <surligas@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Checks the timestamp option: which TSval a receiver echoes while holes
+ * open and fill, and the RTT samples a sender takes from the echo.
+ */
+
+#include "../lib/microtcp.c"
+#include "test_unit.h"
+
+#define ISN 1000
+#define CHUNK 1000
+
+static uint8_t pattern[4 * CHUNK];
+
+/* Builds a data segment of the peer carrying the given TSval */
+static size_t
+peer_segment (uint8_t *buf, uint32_t seq, uint32_t tsval, const uint8_t *data, size_t len)
+{
+  microtcp_header_t header;
+
+  header = make_header(seq, 1, MICROTCP_RECVBUF_LEN, len, 1, 0, 0, 0);
+  header.future_use1 = htonl(tsval);
+  set_segment_checksum(&header, NULL, 0, data, len);
+  memcpy(buf, &header, sizeof(header));
+  memcpy(buf + sizeof(header), data, len);
+  return sizeof(header) + len;
+}
+
+/* Delivers chunk k with the given TSval and returns the TSecr of its ACK */
+static uint32_t
+echo_of (microtcp_sock_t *sock, int peer, int k, uint32_t tsval)
+{
+  uint8_t buf[MICROTCP_MAX_SEGMENT];
+  rx_segment_t ack;
+  size_t len;
+  uint32_t before = ts_now();
+
+  len = peer_segment(buf, ISN + k * CHUNK, tsval, pattern + k * CHUNK, CHUNK);
+  EXPECT(process_segment(sock, buf, len) == 0);
+  if(unit_next_segment(peer, buf, sizeof(buf), &ack) < 0)
+    return 0;
+  /* The TSval of the ACK is the clock of the socket */
+  EXPECT(sock->ts_enabled ? (uint32_t)(ack.header.future_use1 - before) < 1000000
+                          : ack.header.future_use1 == 0);
+  return ack.header.future_use2;
+}
+
+static void
+test_echo (void)
+{
+  microtcp_sock_t sock;
+  int peer;
+
+  unit_connect(&sock, &peer, 1, ISN);
+  sock.ts_enabled = 1;
+
+  EXPECT(echo_of(&sock, peer, 0, 100) == 100);
+  /* Data past a hole does not change the echo */
+  EXPECT(echo_of(&sock, peer, 2, 300) == 100);
+  EXPECT(echo_of(&sock, peer, 3, 400) == 100);
+  /* The segment that fills the hole is the one echoed */
+  EXPECT(echo_of(&sock, peer, 1, 200) == 200);
+  EXPECT(sock.ack_number == ISN + 4 * CHUNK);
+  /* A late duplicate of old data is echoed too, it does not lie past
+     the next expected byte */
+  EXPECT(echo_of(&sock, peer, 0, 500) == 500);
+
+  unit_close(&sock, peer);
+
+  /* Without the option both fields stay zero */
+  unit_connect(&sock, &peer, 1, ISN);
+  EXPECT(echo_of(&sock, peer, 0, 100) == 0);
+  unit_close(&sock, peer);
+}
+
+static void
+test_samples (void)
+{
+  microtcp_sock_t sock;
+  rx_segment_t rx;
+  int peer;
+
+  unit_connect(&sock, &peer, ISN, 1);
+  sock.ts_enabled = 1;
+
+  /* Even the ACK of a retransmission gives a sample, taken from the echo */
+  EXPECT(sndbuf_append(&sock, pattern, MICROTCP_MSS) == MICROTCP_MSS);
+  EXPECT(fill_window(&sock) == 0);
+  retransmission_timeout(&sock);
+  EXPECT(fill_window(&sock) == 0);
+  EXPECT(unit_drain(peer) == 2 && sock.rtx_head->retransmissions == 1);
+
+  memset(&rx, 0, sizeof(rx));
+  rx.header.ack_number = ISN + MICROTCP_MSS;
+  rx.header.window = MICROTCP_RECVBUF_LEN;
+  rx.header.control = set_bit(0, ACK_F);
+  rx.header.future_use2 = ts_now() - 40000;
+  EXPECT(process_ack(&sock, &rx) == 0);
+  EXPECT(sock.srtt_us >= 40000 && sock.srtt_us < 50000);
+
+  unit_close(&sock, peer);
+}
+
+int
+main(int argc, char **argv)
+{
+  size_t i;
+
+  for(i = 0; i < sizeof(pattern); i++)
+    pattern[i] = i * 7 + 3;
+  test_echo();
+  test_samples();
+  return unit_report("Timestamp");
+}
@@ -0,0 +1,210 @@
+/*
+ * microtcp, a lightweight implementation of TCP for teaching,
+ * and academic purposes.
+ *
+ * Copyright (C) 2015-2017  Manolis Surligas <surligas@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Checks the DSACK blocks a receiver sends for duplicate data, and the
+ * undo of a window reduction that DSACK or Eifel detection show to be
+ * spurious.
+ */
+
+#include "../lib/microtcp.c"
+#include "test_unit.h"
+
+#define ISN 1000
+#define CHUNK 1000
+#define SEGS 6
+#define PEER_WINDOW 0xffff
+
+static uint8_t pattern[SEGS * MICROTCP_MSS];
+
+/* Receives chunk k of the pattern and reads back the ACK it triggers */
+static void
+receive_chunk (microtcp_sock_t *sock, int peer, int k, rx_segment_t *ack)
+{
+  static uint8_t buf[MICROTCP_MAX_SEGMENT];
+
+  reassemble(sock, ISN + k * CHUNK, pattern + k * CHUNK, CHUNK);
+  EXPECT(send_ack(sock) == 0);
+  EXPECT(unit_next_segment(peer, buf, sizeof(buf), ack) == 0);
+}
+
+static void
+test_dsack_blocks (void)
+{
+  microtcp_sock_t sock;
+  rx_segment_t ack;
+  int peer;
+
+  unit_connect(&sock, &peer, 1, ISN);
+  sock.sack_permitted = 1;
+
+  /* A duplicate below the cumulative ACK */
+  receive_chunk(&sock, peer, 0, &ack);
+  EXPECT(ack.sack_count == 0);
+  receive_chunk(&sock, peer, 0, &ack);
+  EXPECT(ack.sack_count == 1 && is_dsack(&ack));
+  EXPECT(ack.sack[0].start == ISN && ack.sack[0].end == ISN + CHUNK);
+
+  /* A duplicate of out-of-order data, followed by the range it lies in */
+  receive_chunk(&sock, peer, 2, &ack);
+  EXPECT(ack.sack_count == 1 && !is_dsack(&ack));
+  receive_chunk(&sock, peer, 4, &ack);
+  receive_chunk(&sock, peer, 2, &ack);
+  EXPECT(ack.sack_count == 3 && is_dsack(&ack));
+  EXPECT(ack.sack[0].start == ISN + 2 * CHUNK && ack.sack[0].end == ISN + 3 * CHUNK);
+  EXPECT(ack.sack[1].start == ISN + 2 * CHUNK && ack.sack[1].end == ISN + 3 * CHUNK);
+  EXPECT(ack.sack[2].start == ISN + 4 * CHUNK);
+
+  /* It is reported once */
+  EXPECT(send_ack(&sock) == 0);
+  unit_drain(peer);
+  EXPECT(!sock.dsack_pending);
+  unit_close(&sock, peer);
+}
+
+/* An ACK of the peer */
+static rx_segment_t
+peer_ack (uint32_t ack)
+{
+  rx_segment_t rx;
+
+  memset(&rx, 0, sizeof(rx));
+  rx.header.ack_number = ack;
+  rx.header.window = PEER_WINDOW;
+  rx.header.control = set_bit(0, ACK_F);
+  return rx;
+}
+
+static void
+send_all (microtcp_sock_t *sock, int peer)
+{
+
+  sock->cwnd = SEGS * MICROTCP_MSS;
+  sock->ssthresh = 2 * SEGS * MICROTCP_MSS;
+  sock->curr_win_size = PEER_WINDOW;
+  EXPECT(sndbuf_append(sock, pattern, sizeof(pattern)) == sizeof(pattern));
+  EXPECT(fill_window(sock) == 0);
+  EXPECT(unit_drain(peer) == SEGS);
+}
+
+static void
+test_dsack_undo (void)
+{
+  microtcp_sock_t sock;
+  rx_segment_t rx;
+  size_t cwnd, ssthresh;
+  int peer;
+
+  unit_connect(&sock, &peer, ISN, 1);
+  unit_unpaced(&sock);
+  sock.sack_permitted = 1;
+  sock.srtt_us = 1000000;
+  sock.min_rtt_us = 1000000;
+  send_all(&sock, peer);
+  cwnd = sock.cwnd;
+  ssthresh = sock.ssthresh;
+
+  /* Three segments SACKed above the first one: it is retransmitted */
+  rx = peer_ack(ISN);
+  rx.sack_count = 1;
+  rx.sack[0].start = ISN + MICROTCP_MSS;
+  rx.sack[0].end = ISN + 4 * MICROTCP_MSS;
+  EXPECT(process_ack(&sock, &rx) == 0);
+  EXPECT(sock.in_recovery && sock.ssthresh < ssthresh && sock.undo_retrans == 1);
+  EXPECT(unit_drain(peer) == 1);
+
+  /* The original only came late, and the peer reports it twice */
+  rx = peer_ack(ISN + 4 * MICROTCP_MSS);
+  rx.sack_count = 1;
+  rx.sack[0].start = ISN;
+  rx.sack[0].end = ISN + MICROTCP_MSS;
+  EXPECT(process_ack(&sock, &rx) == 0);
+  EXPECT(!sock.in_recovery && !sock.undo_valid);
+  EXPECT(sock.cwnd >= cwnd && sock.ssthresh == ssthresh);
+
+  /* RACK learns that the path reorders and widens its window, for 16
+     recoveries */
+  EXPECT(sock.rack_reordering_seen && sock.rack_reo_wnd_mult == 2);
+  EXPECT(sock.rack_reo_wnd_persist == 16);
+  while(sock.rack_reo_wnd_persist > 1)
+    rack_recovery_done(&sock);
+  EXPECT(sock.rack_reo_wnd_mult == 2);
+  rack_recovery_done(&sock);
+  EXPECT(sock.rack_reo_wnd_mult == 1);
+  unit_close(&sock, peer);
+}
+
+static void
+test_eifel_undo (void)
+{
+  microtcp_sock_t sock;
+  rx_segment_t rx;
+  size_t cwnd, ssthresh;
+  int peer;
+
+  unit_connect(&sock, &peer, ISN, 1);
+  sock.ts_enabled = 1;
+  send_all(&sock, peer);
+  cwnd = sock.cwnd;
+  ssthresh = sock.ssthresh;
+
+  /* A timeout takes everything for lost, only the first segment fits in
+     the collapsed window */
+  retransmission_timeout(&sock);
+  EXPECT(sock.cwnd == MICROTCP_MSS && sock.undo_valid && sock.undo_rto);
+  EXPECT(fill_window(&sock) == 0);
+  EXPECT(unit_drain(peer) == 1 && sock.undo_ts != 0);
+
+  /* An ACK that echoes the timestamp of the retransmission proves nothing */
+  rx = peer_ack(ISN + MICROTCP_MSS);
+  rx.header.future_use2 = sock.undo_ts;
+  EXPECT(process_ack(&sock, &rx) == 0);
+  EXPECT(sock.undo_valid && sock.undo_ts == 0 && sock.cwnd < cwnd);
+  unit_close(&sock, peer);
+
+  unit_connect(&sock, &peer, ISN, 1);
+  sock.ts_enabled = 1;
+  send_all(&sock, peer);
+  retransmission_timeout(&sock);
+  EXPECT(fill_window(&sock) == 0);
+  EXPECT(unit_drain(peer) == 1);
+
+  /* One that echoes an older one was sent for the original: the window
+     comes back, and what the timeout took for lost is in flight again */
+  rx = peer_ack(ISN + MICROTCP_MSS);
+  rx.header.future_use2 = sock.undo_ts - 1000;
+  EXPECT(process_ack(&sock, &rx) == 0);
+  EXPECT(!sock.undo_valid && sock.cwnd >= cwnd && sock.ssthresh == ssthresh);
+  EXPECT(!sock.rtx_head->lost && sock.bytes_in_flight == (SEGS - 1) * MICROTCP_MSS);
+  unit_close(&sock, peer);
+}
+
+int
+main(int argc, char **argv)
+{
+  size_t i;
+
+  for(i = 0; i < sizeof(pattern); i++)
+    pattern[i] = i * 7 + 3;
+  test_dsack_blocks();
+  test_dsack_undo();
+  test_eifel_undo();
+  return unit_report("Undo");
+}
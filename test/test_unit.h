@@ -0,0 +1,147 @@
+/*
+ * microtcp, a lightweight implementation of TCP for teaching,
+ * and academic purposes.
+ *
+ * Copyright (C) 2015-2017  Manolis Surligas <surligas@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Helpers of the unit tests. A unit test includes lib/microtcp.c whole to
+ * reach its static helpers and drives them on a socket connected to a plain
+ * UDP socket of the test, where every segment the socket sends is read back.
+ */
+
+#ifndef TEST_TEST_UNIT_H_
+#define TEST_TEST_UNIT_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+
+static int failures;
+
+#define EXPECT(cond)                                                        \
+  do{                                                                       \
+    if(!(cond)){                                                            \
+      fprintf(stderr, "%s:%d: %s failed\n", __FILE__, __LINE__, #cond);     \
+      failures++;                                                           \
+    }                                                                       \
+  }while(0)
+
+/* Puts sock in the ESTABLISHED state, connected to *peer, a nonblocking UDP
+   socket on the loopback. snd_isn and rcv_isn are the next sequence numbers
+   of each direction. As if the peer sent no options: every data segment
+   is acknowledged at once */
+static void
+unit_connect (microtcp_sock_t *sock, int *peer, uint32_t snd_isn, uint32_t rcv_isn)
+{
+  struct sockaddr_in sin;
+  socklen_t len = sizeof(sin);
+
+  *sock = microtcp_socket(AF_INET, 0, 0);
+  *peer = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, IPPROTO_UDP);
+  memset(&sin, 0, sizeof(sin));
+  sin.sin_family = AF_INET;
+  sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if(sock->state == INVALID || *peer < 0
+     || bind(*peer, (struct sockaddr *)&sin, sizeof(sin)) < 0
+     || getsockname(*peer, (struct sockaddr *)&sin, &len) < 0
+     || alloc_recvbuf(sock) < 0){
+    perror("setting up the test connection");
+    exit(EXIT_FAILURE);
+  }
+  memcpy(&sock->address, &sin, sizeof(sin));
+  sock->address_len = sizeof(sin);
+  sock->state = ESTABLISHED;
+  sock->seq_number = snd_isn;
+  sock->snd_una = snd_isn;
+  sock->write_seq = snd_isn;
+  sock->ack_number = rcv_isn;
+  sock->last_ack_sent = rcv_isn;
+  sock->ack_freq = 1;
+}
+
+static uint64_t
+unit_unpaced_rate (const microtcp_sock_t *socket)
+{
+  return UINT64_MAX;
+}
+
+/* Lets sock send every segment the window allows at once, for the tests
+   that fake a long RTT to check the window logic and would otherwise wait
+   on the pacing timer */
+static void
+unit_unpaced (microtcp_sock_t *sock)
+{
+  static microtcp_cc_ops_t ops;
+
+  ops = *sock->cc;
+  ops.pacing_rate = unit_unpaced_rate;
+  sock->cc = &ops;
+}
+
+static void
+unit_close (microtcp_sock_t *sock, int peer)
+{
+  free_rtx_queue(sock);
+  free_recvbuf(sock);
+  close(sock->sd);
+  close(peer);
+}
+
+/* Reads the next segment the socket sent into buf and splits it into rx.
+   Returns 0 on success, -1 if nothing arrived or the segment is malformed */
+static int
+unit_next_segment (int peer, uint8_t *buf, size_t len, rx_segment_t *rx)
+{
+  ssize_t ret = recv(peer, buf, len, 0);
+
+  if(ret < 0)
+    return -1;
+  if(!is_checksum_valid(buf, ret) || parse_segment(buf, ret, rx) < 0){
+    fprintf(stderr, "malformed segment of %zd bytes\n", ret);
+    failures++;
+    return -1;
+  }
+  return 0;
+}
+
+/* Discards every segment waiting at the peer. Returns how many there were */
+static int
+unit_drain (int peer)
+{
+  uint8_t buf[MICROTCP_MAX_SEGMENT];
+  int n = 0;
+
+  while(recv(peer, buf, sizeof(buf), 0) >= 0)
+    n++;
+  return n;
+}
+
+static int
+unit_report (const char *what)
+{
+  if(failures){
+    fprintf(stderr, "%d checks failed\n", failures);
+    return EXIT_FAILURE;
+  }
+  printf("%s checks passed\n", what);
+  return EXIT_SUCCESS;
+}
+
+#endif /* TEST_TEST_UNIT_H_ */
@@ -0,0 +1,110 @@
+/*
+ * microtcp, a lightweight implementation of TCP for teaching,
+ * and academic purposes.
+ *
+ * Copyright (C) 2015-2017  Manolis Surligas <surligas@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Checks window scaling: the shift chosen for a receive buffer, the scaled
+ * windows a receiver advertises and the windows a sender takes from them.
+ */
+
+#include "../lib/microtcp.c"
+#include "test_unit.h"
+
+#define ISN 1000
+#define CHUNK 1000
+#define BIG_RECVBUF (1u << 20)
+
+static uint8_t pattern[CHUNK];
+
+static void
+test_shift (void)
+{
+  EXPECT(wscale_for(MICROTCP_RECVBUF_LEN) == 0);
+  EXPECT(wscale_for(0xffff) == 0);
+  EXPECT(wscale_for(0x10000) == 1);
+  EXPECT(wscale_for(BIG_RECVBUF) == 5);
+  EXPECT(wscale_for((size_t)-1) == MICROTCP_MAX_WSCALE);
+}
+
+static void
+test_advertised (void)
+{
+  microtcp_sock_t sock;
+  uint8_t buf[MICROTCP_MAX_SEGMENT];
+  rx_segment_t ack;
+  int peer;
+
+  unit_connect(&sock, &peer, 1, ISN);
+  free_recvbuf(&sock);
+  sock.recvbuf_len = BIG_RECVBUF;
+  EXPECT(alloc_recvbuf(&sock) == 0);
+
+  /* A SYN never carries a scaled window */
+  EXPECT(syn_window(&sock) == 0xffff);
+
+  /* Unscaled, the free space is clamped to the field */
+  EXPECT(advertised_window(&sock) == 0xffff);
+
+  /* Scaled, it is rounded down so that no more is promised than fits */
+  sock.rcv_wscale = wscale_for(sock.recvbuf_len);
+  reassemble(&sock, ISN, pattern, CHUNK);
+  EXPECT(send_ack(&sock) == 0);
+  EXPECT(unit_next_segment(peer, buf, sizeof(buf), &ack) == 0);
+  EXPECT(ack.header.window == (BIG_RECVBUF - CHUNK) >> 5);
+  EXPECT((size_t)ack.header.window << 5 <= BIG_RECVBUF - CHUNK);
+  unit_close(&sock, peer);
+}
+
+static void
+test_received (void)
+{
+  microtcp_sock_t sock;
+  rx_segment_t rx;
+  int peer;
+
+  unit_connect(&sock, &peer, ISN, 1);
+  sock.snd_wscale = 7;
+
+  memset(&rx, 0, sizeof(rx));
+  rx.header.ack_number = ISN;
+  rx.header.window = 1000;
+  rx.header.control = set_bit(0, ACK_F);
+  EXPECT(process_ack(&sock, &rx) == 0);
+  EXPECT(sock.curr_win_size == 1000 << 7);
+
+  /* The largest window there is does not overflow */
+  sock.snd_wscale = MICROTCP_MAX_WSCALE;
+  rx.header.window = 0xffff;
+  EXPECT(process_ack(&sock, &rx) == 0);
+  EXPECT(sock.curr_win_size == (size_t)0xffff << MICROTCP_MAX_WSCALE);
+  unit_close(&sock, peer);
+}
+
+int
+main(int argc, char **argv)
+{
+  size_t i;
+
+  for(i = 0; i < sizeof(pattern); i++)
+    pattern[i] = i * 7 + 3;
+  test_shift();
+  test_advertised();
+  test_received();
+  return unit_report("Window scale");
+}